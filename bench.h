@@ -0,0 +1,113 @@
+#pragma once
+
+// frame time statistics and the json report of the --bench mode of both renderers.
+// every scene renders a few unmeasured warmup frames first, then the measured ones
+// along a fixed camera path, so runs on the same machine are comparable
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <cmath>
+
+#include "camera_path.h"
+
+// the camera paths of the scenes both renderers run, over t = 0..1, so the cpu and gpu
+// numbers of a scene compare: an orbit around the planets, and a camera close enough
+// for the throat to fill most of the view, where rays take the most steps
+inline std::vector<Keyframe> benchOrbitPath() {
+    return {{0.0f, 0.0f, 75.0f, 220.0f, glm::vec3(0.0f)}, {1.0f, 360.0f, 100.0f, 220.0f, glm::vec3(0.0f)}};
+}
+
+inline std::vector<Keyframe> benchThroatPath() {
+    return {{0.0f, 90.0f, 90.0f, 40.0f, glm::vec3(0.0f)}, {1.0f, 120.0f, 90.0f, 35.0f, glm::vec3(0.0f)}};
+}
+
+struct BenchScene {
+    std::string name;
+    std::string config;           // what the renderer was doing, e.g. the lensing mode
+    std::vector<double> frameMs;  // measured frames only, in render order
+    std::vector<double> gpuMs;    // gpu time of the same frames, empty on the cpu
+    double raysPerFrame = 0.0;    // primary rays, including supersampling
+    double steps = -1.0;          // integration steps of all measured frames, negative when not counted
+
+    double totalSeconds() const {
+        double sum = 0.0;
+        for (double ms : frameMs) sum += ms;
+        return sum * 1e-3;
+    }
+};
+
+// nearest rank, so p99 of a short run is its slowest frame rather than an interpolation
+inline double benchPercentile(std::vector<double> values, double q) {
+    if (values.empty()) return 0.0;
+    std::sort(values.begin(), values.end());
+    size_t rank = (size_t)std::ceil(q * (double)values.size());
+    return values[std::min(values.size() - 1, rank > 0 ? rank - 1 : 0)];
+}
+
+inline void writeBenchValues(std::ostream& out, const std::vector<double>& values) {
+    out << "[";
+    for (size_t i = 0; i < values.size(); ++i) {
+        out << (i ? ", " : "") << values[i];
+    }
+    out << "]";
+}
+
+// one object per run. info holds extra "key": value pairs about the setup, with the
+// values already formatted as json
+inline bool writeBenchJson(const std::string& path, const std::string& renderer,
+                           const std::vector<std::pair<std::string, std::string>>& info,
+                           const std::vector<BenchScene>& scenes) {
+    std::ofstream out(path);
+    if (!out.is_open()) {
+        return false;
+    }
+    out << std::setprecision(6) << "{\n  \"renderer\": \"" << renderer << "\",\n";
+    for (const auto& kv : info) {
+        out << "  \"" << kv.first << "\": " << kv.second << ",\n";
+    }
+    out << "  \"scenes\": [\n";
+    for (size_t i = 0; i < scenes.size(); ++i) {
+        const BenchScene& s = scenes[i];
+        double seconds = s.totalSeconds();
+        out << "    {\n"
+            << "      \"name\": \"" << s.name << "\",\n"
+            << "      \"config\": \"" << s.config << "\",\n"
+            << "      \"frames\": " << s.frameMs.size() << ",\n"
+            << "      \"median_ms\": " << benchPercentile(s.frameMs, 0.5) << ",\n"
+            << "      \"p99_ms\": " << benchPercentile(s.frameMs, 0.99) << ",\n";
+        if (!s.gpuMs.empty()) {
+            out << "      \"gpu_median_ms\": " << benchPercentile(s.gpuMs, 0.5) << ",\n"
+                << "      \"gpu_p99_ms\": " << benchPercentile(s.gpuMs, 0.99) << ",\n";
+        }
+        out << "      \"rays_per_sec\": " << (seconds > 0.0 ? s.raysPerFrame * s.frameMs.size() / seconds : 0.0) << ",\n"
+            << "      \"steps_per_sec\": ";
+        if (s.steps >= 0.0 && seconds > 0.0) {
+            out << s.steps / seconds;
+        } else {
+            out << "null";
+        }
+        out << ",\n      \"frame_ms\": ";
+        writeBenchValues(out, s.frameMs);
+        out << "\n    }" << (i + 1 < scenes.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+    return (bool)out;
+}
+
+inline void printBenchScene(const BenchScene& s) {
+    std::cout << std::fixed << std::setprecision(2) << s.name << " (" << s.config << "): median "
+              << benchPercentile(s.frameMs, 0.5) << " ms, p99 " << benchPercentile(s.frameMs, 0.99) << " ms";
+    double seconds = s.totalSeconds();
+    if (seconds > 0.0) {
+        std::cout << ", " << s.raysPerFrame * s.frameMs.size() / seconds * 1e-6 << " Mrays/s";
+        if (s.steps >= 0.0) {
+            std::cout << ", " << s.steps / seconds * 1e-6 << " Msteps/s";
+        }
+    }
+    std::cout << "\n";
+    std::cout.unsetf(std::ios::fixed);
+}
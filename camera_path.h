@@ -0,0 +1,60 @@
+#pragma once
+
+// camera_path.txt keyframes, shared by the movie mode of wormhole_sim.cpp and the
+// distributed renderer in wormhole_geodesic.cpp. every non-comment line is
+//   time_sec azimuth_deg elevation_deg radius target_x target_y target_z
+// and the camera orbits the interpolated target on the interpolated sphere
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+
+#include <glm/glm.hpp>
+
+struct Keyframe {
+    float timeSec;
+    float posAzimuthDeg;
+    float posElevationDeg;
+    float posRadius;
+    glm::vec3 target;
+};
+
+inline bool loadCameraPath(const std::string& pathFile, std::vector<Keyframe>& out) {
+    std::ifstream in(pathFile);
+    if (!in.is_open()) return false;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream ss(line);
+        Keyframe k{};
+        if (!(ss >> k.timeSec >> k.posAzimuthDeg >> k.posElevationDeg >> k.posRadius >> k.target.x >> k.target.y >> k.target.z)) continue;
+        out.push_back(k);
+    }
+    return !out.empty();
+}
+
+// camera position and target at the given time, linear between the surrounding keyframes
+inline void cameraPathAt(const std::vector<Keyframe>& keys, float time, glm::vec3& pos, glm::vec3& target) {
+    size_t index = 0;
+    while (index + 1 < keys.size() && keys[index + 1].timeSec < time) {
+        index++;
+    }
+
+    const Keyframe& a = keys[index];
+    const Keyframe& b = keys[index + 1 < keys.size() ? index + 1 : index];
+
+    float t = 0.0f;
+    if (b.timeSec > a.timeSec) {
+        t = (time - a.timeSec) / (b.timeSec - a.timeSec);
+    }
+
+    float az = glm::radians(glm::mix(a.posAzimuthDeg, b.posAzimuthDeg, t));
+    float el = glm::radians(glm::mix(a.posElevationDeg, b.posElevationDeg, t));
+    float rr = glm::mix(a.posRadius, b.posRadius, t);
+    target = glm::mix(a.target, b.target, t);
+
+    pos.x = target.x + rr * std::sin(el) * std::cos(az);
+    pos.y = target.y + rr * std::cos(el);
+    pos.z = target.z + rr * std::sin(el) * std::sin(az);
+}
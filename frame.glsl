@@ -0,0 +1,25 @@
+// per-frame scalars, written once per frame by Engine::beginFrame. shared by every
+// compute shader through #include, and mirrored by FrameData in wormhole_sim.cpp
+layout(std140, binding = 1) uniform Frame {
+    vec3 sunPosU1;
+    float time;
+    vec3 sunColorU1;
+    int currentUniverse;
+    vec3 sunPosU2;
+    int numSpheres;
+    vec3 sunColorU2;
+    int numStars;
+    vec3 meshBoundsMin;
+    int numTriangles;
+    vec3 meshQuantizeScale;
+    int starfieldMode;
+    ivec2 bvhRoots; // root node per universe, -1 if it has no primitives
+    int starCellGrid;
+    float geodesicTolerance; // per-step error target of geodesic.comp
+    ivec2 renderExtent; // pixels actually traced, smaller than destTex when upsampling
+    vec2 jitter;        // subpixel offset of this frame's samples
+    int geodesicLut;    // 1 to take geodesic.comp's lens sphere exits from deflectionLut
+    float lutMaxRadius; // lens sphere radius of deflectionLut, in throat radii
+    int debugView;      // DEBUG_VIEW_* heatmap written instead of the color, 0 for none
+    int _pad1;
+};
@@ -0,0 +1,287 @@
+#pragma once
+
+// hdr frame output, shared by the movie mode of wormhole_sim.cpp and the geodesic
+// renderer. frames come in as top-down rgba half floats, which the gpu renderer reads
+// back directly, and leave either as one uncompressed openexr file per frame or
+// appended to a single raw stream:
+//   HdrStreamHeader, then per frame an int32 frame index, 4 bytes of padding and
+//   width * height * 4 halfs
+// frames of a distributed render can finish out of order; the index says which one
+// each record is. all multi-byte values are little endian, as exr requires, so this
+// assumes a little endian machine like the network protocol does
+
+#include <vector>
+#include <string>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <filesystem>
+#include <iostream>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+
+enum HdrFormat {
+    HDR_NONE, // 8-bit output as before
+    HDR_EXR,  // frame_00000.exr, ... in a directory
+    HDR_RAW,  // every frame in one .hraw stream
+};
+
+// the value of --hdr, false for anything but exr or raw
+inline bool parseHdrFormat(const std::string& name, HdrFormat& format) {
+    if (name == "exr") {
+        format = HDR_EXR;
+    } else if (name == "raw") {
+        format = HDR_RAW;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const int HDR_QUEUE_SIZE = 8;                    // frames buffered between the renderer and the writers
+const size_t HDR_STREAM_BUFFER = 16 << 20;       // stdio buffer of the raw stream, so it's written in large blocks
+const uint32_t HDR_STREAM_MAGIC = 0x52444857;    // "WHDR"
+const uint32_t HDR_STREAM_VERSION = 1;
+
+struct HdrStreamHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t width, height;
+    uint32_t channels; // 4, rgba
+    uint32_t fps;
+};
+
+// round to nearest even, overflow goes to infinity
+inline uint16_t floatToHalf(float value) {
+    uint32_t f;
+    memcpy(&f, &value, sizeof(f));
+    uint32_t sign = (f >> 16) & 0x8000u;
+    uint32_t exponent = (f >> 23) & 0xffu;
+    uint32_t mantissa = f & 0x7fffffu;
+    if (exponent == 0xffu) {
+        return (uint16_t)(sign | 0x7c00u | (mantissa ? 0x200u : 0u)); // inf, nan stays nan
+    }
+    int e = (int)exponent - 127 + 15;
+    if (e >= 31) {
+        return (uint16_t)(sign | 0x7c00u);
+    }
+    uint32_t half, rest, halfway;
+    if (e <= 0) {
+        if (e < -10) {
+            return (uint16_t)sign; // below the smallest denormal
+        }
+        mantissa |= 0x800000u;
+        int shift = 14 - e;
+        half = mantissa >> shift;
+        rest = mantissa & ((1u << shift) - 1);
+        halfway = 1u << (shift - 1);
+    } else {
+        half = ((uint32_t)e << 10) | (mantissa >> 13);
+        rest = mantissa & 0x1fffu;
+        halfway = 0x1000u;
+    }
+    if (rest > halfway || (rest == halfway && (half & 1u))) {
+        half++; // a carry out of the mantissa correctly bumps the exponent
+    }
+    return (uint16_t)(sign | half);
+}
+
+// a single part scanline exr without compression, with the r, g and b channels of
+// rgba, a top-down width * height * 4 half image
+inline bool writeExr(const std::string& path, int width, int height, const uint16_t* rgba) {
+    std::vector<char> header;
+    auto put = [&](const void* data, size_t size) {
+        header.insert(header.end(), (const char*)data, (const char*)data + size);
+    };
+    auto putInt = [&](int32_t v) { put(&v, sizeof(v)); };
+    auto putString = [&](const char* s) { put(s, strlen(s) + 1); };
+    auto attribute = [&](const char* name, const char* type, int32_t size) {
+        putString(name);
+        putString(type);
+        putInt(size);
+    };
+
+    const uint32_t magic = 20000630;
+    const uint32_t version = 2; // single part scanline
+    put(&magic, sizeof(magic));
+    put(&version, sizeof(version));
+
+    const char* channels[3] = {"B", "G", "R"}; // sorted by name, as the format wants
+    attribute("channels", "chlist", 3 * 18 + 1);
+    for (const char* name : channels) {
+        putString(name);
+        putInt(1); // HALF
+        const char linearAndReserved[4] = {0, 0, 0, 0};
+        put(linearAndReserved, sizeof(linearAndReserved));
+        putInt(1); // x sampling
+        putInt(1); // y sampling
+    }
+    header.push_back('\0');
+    attribute("compression", "compression", 1);
+    header.push_back(0); // NO_COMPRESSION
+    for (const char* window : {"dataWindow", "displayWindow"}) {
+        attribute(window, "box2i", 16);
+        putInt(0);
+        putInt(0);
+        putInt(width - 1);
+        putInt(height - 1);
+    }
+    attribute("lineOrder", "lineOrder", 1);
+    header.push_back(0); // INCREASING_Y
+    const float one = 1.0f, zero[2] = {0.0f, 0.0f};
+    attribute("pixelAspectRatio", "float", 4);
+    put(&one, sizeof(one));
+    attribute("screenWindowCenter", "v2f", 8);
+    put(zero, sizeof(zero));
+    attribute("screenWindowWidth", "float", 4);
+    put(&one, sizeof(one));
+    header.push_back('\0');
+
+    // one scanline per chunk: y, byte count, then the line of every channel in turn
+    int32_t lineBytes = width * 3 * (int32_t)sizeof(uint16_t);
+    uint64_t chunkStart = header.size() + (uint64_t)height * sizeof(uint64_t);
+    for (int y = 0; y < height; ++y) {
+        uint64_t offset = chunkStart + (uint64_t)y * (8 + lineBytes);
+        put(&offset, sizeof(offset));
+    }
+
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f) {
+        return false;
+    }
+    bool ok = fwrite(header.data(), 1, header.size(), f) == header.size();
+    std::vector<uint16_t> line((size_t)width * 3);
+    for (int y = 0; y < height && ok; ++y) {
+        const uint16_t* src = rgba + (size_t)y * width * 4;
+        for (int c = 0; c < 3; ++c) {
+            int channel = 2 - c; // b, g, r
+            for (int x = 0; x < width; ++x) {
+                line[(size_t)c * width + x] = src[x * 4 + channel];
+            }
+        }
+        int32_t chunk[2] = {y, lineBytes};
+        ok = fwrite(chunk, sizeof(chunk), 1, f) == 1 && fwrite(line.data(), 1, lineBytes, f) == (size_t)lineBytes;
+    }
+    return fclose(f) == 0 && ok;
+}
+
+// writes submitted frames in the background. exr frames are encoded and written by a
+// small pool, one file each, raw frames are appended to the stream by one thread in the
+// order they were submitted. submit blocks while HDR_QUEUE_SIZE frames are waiting, and
+// written buffers are recycled through acquireBuffer
+struct HdrFrameWriter {
+    struct Frame {
+        int index;
+        std::vector<uint16_t> pixels;
+    };
+
+    HdrFormat format = HDR_NONE;
+    int width = 0, height = 0;
+    std::string path;      // directory of the exr files, or the raw stream
+    FILE* stream = nullptr;
+    bool failed = false;
+
+    std::mutex mtx;
+    std::condition_variable canSubmit, hasWork;
+    std::deque<Frame> pending;
+    std::vector<std::vector<uint16_t>> freeBuffers;
+    bool closing = false;
+    std::vector<std::thread> workers;
+
+    bool open(HdrFormat f, const std::string& outputPath, int w, int h, int fps) {
+        format = f;
+        path = outputPath;
+        width = w;
+        height = h;
+        int numWorkers = 1;
+        if (format == HDR_RAW) {
+            stream = fopen(path.c_str(), "wb");
+            if (!stream) {
+                return false;
+            }
+            setvbuf(stream, nullptr, _IOFBF, HDR_STREAM_BUFFER);
+            HdrStreamHeader header = {HDR_STREAM_MAGIC, HDR_STREAM_VERSION, (uint32_t)w, (uint32_t)h, 4, (uint32_t)fps};
+            failed = fwrite(&header, sizeof(header), 1, stream) != 1;
+        } else {
+            std::error_code ec;
+            std::filesystem::create_directories(path, ec);
+            numWorkers = std::max(1, std::min(4, (int)std::thread::hardware_concurrency() - 1));
+        }
+        for (int i = 0; i < numWorkers; ++i) {
+            workers.emplace_back([this] { writeLoop(); });
+        }
+        return true;
+    }
+
+    size_t frameValues() const { return (size_t)width * height * 4; }
+
+    std::vector<uint16_t> acquireBuffer() {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (freeBuffers.empty()) return std::vector<uint16_t>();
+        std::vector<uint16_t> buf = std::move(freeBuffers.back());
+        freeBuffers.pop_back();
+        return buf;
+    }
+
+    void submit(int index, std::vector<uint16_t>&& pixels) {
+        std::unique_lock<std::mutex> lock(mtx);
+        canSubmit.wait(lock, [this] { return (int)pending.size() < HDR_QUEUE_SIZE; });
+        pending.push_back({index, std::move(pixels)});
+        hasWork.notify_one();
+    }
+
+    std::string framePath(int index) const {
+        char name[32];
+        snprintf(name, sizeof(name), "/frame_%05d.exr", index);
+        return path + name;
+    }
+
+    void writeLoop() {
+        for (;;) {
+            Frame frame;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                hasWork.wait(lock, [this] { return closing || !pending.empty(); });
+                if (pending.empty()) return;
+                frame = std::move(pending.front());
+                pending.pop_front();
+                canSubmit.notify_one();
+            }
+
+            bool ok = frame.pixels.size() == frameValues();
+            if (ok && format == HDR_RAW) {
+                int32_t record[2] = {frame.index, 0};
+                ok = fwrite(record, sizeof(record), 1, stream) == 1 &&
+                     fwrite(frame.pixels.data(), sizeof(uint16_t), frame.pixels.size(), stream) == frame.pixels.size();
+            } else if (ok) {
+                ok = writeExr(framePath(frame.index), width, height, frame.pixels.data());
+            }
+
+            std::lock_guard<std::mutex> lock(mtx);
+            if (!ok && !failed) {
+                std::cerr << "\nerror: failed to write hdr frame " << frame.index << "\n";
+            }
+            failed = failed || !ok;
+            freeBuffers.push_back(std::move(frame.pixels));
+        }
+    }
+
+    // writes out everything submitted, false if any frame failed
+    bool close() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            closing = true;
+        }
+        hasWork.notify_all();
+        for (auto& w : workers) w.join();
+        workers.clear();
+        if (stream) {
+            failed = fclose(stream) != 0 || failed;
+            stream = nullptr;
+        }
+        return !failed;
+    }
+};
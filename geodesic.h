@@ -0,0 +1,291 @@
+#pragma once
+
+// null geodesics of the Morris-Thorne (Ellis) wormhole, shared by the cpu renderer in
+// wormhole_geodesic.cpp and by wormhole_sim.cpp, which bakes the deflection table for
+// geodesic.comp from it. geodesic.comp carries a glsl copy of the integrator.
+//
+// a ray stays in the plane through the throat center spanned by its start position
+// and direction, so it is integrated there in the proper radial distance l (positive
+// in universe 1, negative in universe 2) and the in-plane angle phi
+
+#include <vector>
+#include <string>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+const float GEODESIC_INITIAL_STEP = 0.5f;
+const float GEODESIC_MIN_STEP = 1e-3f;
+const float GEODESIC_MAX_STEP_FRACTION = 0.5f; // of the distance to the throat, keeps chords close to the path
+const float DEFAULT_GEODESIC_TOLERANCE = 1e-5f; // per-step error, relative in l, absolute in phi and p
+const int GEODESIC_MAX_STEPS = 1000;            // attempted steps, rejected ones included
+const float GEODESIC_ESCAPE_FACTOR = 20.0f;     // escape radius in throat radii, lensing is negligible past it
+
+const int DEFLECTION_LUT_RADII = 128;
+const int DEFLECTION_LUT_ANGLES = 1024;
+const float DEFLECTION_LUT_RADIUS = 4.0f; // default outer radius of the tabulated lens sphere, in throat radii
+
+// T is float for a single ray, or FloatN from simd.h for a packet of them
+template <typename T>
+struct GeodesicState {
+    using Scalar = T;
+    T l;   // proper radial distance
+    T phi; // angle in the ray's plane
+    T p;   // dl/dlambda
+};
+
+using GeodesicRay = GeodesicState<float>;
+
+template <typename T>
+inline GeodesicState<T> operator+(const GeodesicState<T>& a, const GeodesicState<T>& b) {
+    return {a.l + b.l, a.phi + b.phi, a.p + b.p};
+}
+
+template <typename T>
+inline GeodesicState<T> operator*(const GeodesicState<T>& a, typename GeodesicState<T>::Scalar s) {
+    return {a.l * s, a.phi * s, a.p * s};
+}
+
+// the geodesic equations of ds^2 = -dt^2 + dl^2 + r^2 dOmega^2 with r^2 = l^2 + b^2,
+// b the throat radius and L the conserved angular momentum:
+//   dl/dlambda = p,  dphi/dlambda = L / r^2,  dp/dlambda = L^2 l / r^4
+template <typename T>
+inline GeodesicState<T> geodesicDerivatives(const GeodesicState<T>& ray, T L, float b) {
+    T r2 = ray.l * ray.l + b * b;
+    return {ray.p, L / r2, L * L * ray.l / (r2 * r2)};
+}
+
+// one dormand-prince 5(4) step. k1 is the derivative at the start, and k7 comes back
+// as the derivative at the end, which is the next step's k1 when the step is accepted.
+// error is the difference to the embedded 4th order solution, scaled by the tolerance
+template <typename T>
+inline GeodesicState<T> dormandPrinceStep(const GeodesicState<T>& ray, const GeodesicState<T>& k1, T L, T h,
+                                          float b, float tolerance, GeodesicState<T>& k7, T& error) {
+    using std::abs;
+    using std::max;
+    using std::sqrt;
+    using GeodesicRay = GeodesicState<T>;
+    GeodesicRay k2 = geodesicDerivatives(ray + k1 * (h / 5.0f), L, b);
+    GeodesicRay k3 = geodesicDerivatives(ray + (k1 * (3.0f / 40.0f) + k2 * (9.0f / 40.0f)) * h, L, b);
+    GeodesicRay k4 = geodesicDerivatives(ray + (k1 * (44.0f / 45.0f) + k2 * (-56.0f / 15.0f) + k3 * (32.0f / 9.0f)) * h, L, b);
+    GeodesicRay k5 = geodesicDerivatives(ray + (k1 * (19372.0f / 6561.0f) + k2 * (-25360.0f / 2187.0f) +
+                                                k3 * (64448.0f / 6561.0f) + k4 * (-212.0f / 729.0f)) * h, L, b);
+    GeodesicRay k6 = geodesicDerivatives(ray + (k1 * (9017.0f / 3168.0f) + k2 * (-355.0f / 33.0f) + k3 * (46732.0f / 5247.0f) +
+                                                k4 * (49.0f / 176.0f) + k5 * (-5103.0f / 18656.0f)) * h, L, b);
+    GeodesicRay next = ray + (k1 * (35.0f / 384.0f) + k3 * (500.0f / 1113.0f) + k4 * (125.0f / 192.0f) +
+                              k5 * (-2187.0f / 6784.0f) + k6 * (11.0f / 84.0f)) * h;
+    k7 = geodesicDerivatives(next, L, b);
+
+    GeodesicRay delta = (k1 * (71.0f / 57600.0f) + k3 * (-71.0f / 16695.0f) + k4 * (71.0f / 1920.0f) +
+                         k5 * (-17253.0f / 339200.0f) + k6 * (22.0f / 525.0f) + k7 * (-1.0f / 40.0f)) * h;
+    T r = sqrt(ray.l * ray.l + b * b);
+    error = max(abs(delta.l) / r, max(abs(delta.phi), abs(delta.p))) / tolerance;
+    return next;
+}
+
+// standard step size controller, aiming for an error of 1 with some safety margin
+inline float nextStepSize(float h, float error) {
+    float factor = 0.9f * std::pow(std::max(error, 1e-10f), -0.2f);
+    return h * glm::clamp(factor, 0.2f, 5.0f);
+}
+
+// the plane a ray is integrated in, and the mapping between plane states and scene
+// coordinates. universe 2 is mirrored through the throat center, so a ray falling
+// straight in comes out on the far side
+struct GeodesicPlane {
+    glm::vec3 center;
+    glm::vec3 e1, e2; // e1 points from the center to the start, e2 along the start direction
+    float b;          // throat radius
+    float L;          // conserved angular momentum
+    GeodesicRay start;
+
+    GeodesicPlane() = default;
+    GeodesicPlane(const glm::vec3& origin, const glm::vec3& direction, const glm::vec3& throatCenter,
+                  float throatRadius, int universe)
+        : center(throatCenter), b(throatRadius) {
+        float side = (universe == 1) ? 1.0f : -1.0f;
+        glm::vec3 offset = origin - center;
+        float dist = glm::length(offset);
+        float R = std::max(dist, b * 1.0001f);
+        e1 = side * (dist > 0.0f ? offset / dist : glm::vec3(0, 0, 1));
+        float p = glm::dot(direction, e1);
+        glm::vec3 tangential = direction - p * e1;
+        float tangentialLength = glm::length(tangential);
+        e2 = tangentialLength > 1e-6f ? side * tangential / tangentialLength
+                                      : glm::normalize(glm::cross(e1, std::abs(e1.y) < 0.9f ? glm::vec3(0, 1, 0) : glm::vec3(1, 0, 0)));
+        L = R * tangentialLength;
+        start = {side * std::sqrt(R * R - b * b), 0.0f, p};
+    }
+
+    float radius(const GeodesicRay& ray) const {
+        return std::sqrt(ray.l * ray.l + b * b);
+    }
+
+    glm::vec3 position(const GeodesicRay& ray) const {
+        float side = ray.l >= 0.0f ? 1.0f : -1.0f;
+        return center + side * radius(ray) * (std::cos(ray.phi) * e1 + std::sin(ray.phi) * e2);
+    }
+
+    glm::vec3 direction(const GeodesicRay& ray) const {
+        float side = ray.l >= 0.0f ? 1.0f : -1.0f;
+        glm::vec3 radial = std::cos(ray.phi) * e1 + std::sin(ray.phi) * e2;
+        glm::vec3 tangent = -std::sin(ray.phi) * e1 + std::cos(ray.phi) * e2;
+        return glm::normalize(ray.p * radial + side * (L / radius(ray)) * tangent);
+    }
+
+    // the state where the ray leaves the sphere of the given areal radius on the given
+    // side, moving outward, after having turned by phi
+    GeodesicRay exitState(float exitRadius, float phi, float side) const {
+        float r = std::max(exitRadius, b);
+        float p = std::sqrt(std::max(0.0f, 1.0f - (L * L) / (r * r)));
+        return {side * std::sqrt(r * r - b * b), phi, side * p};
+    }
+};
+
+// deflection table: by spherical symmetry, where a ray leaves the lens sphere depends
+// only on the areal radius R it starts at and its angle alpha to the outward radial.
+// everything is in units of the throat radius, so one table serves any throat size.
+// each texel holds (phi turned until the exit, 1 if it crossed the throat, path length,
+// 1 if it got out at all). radii are spaced quadratically towards the throat
+struct DeflectionTable {
+    int radii = 0;
+    int angles = 0;
+    float maxRadius = 0.0f;
+    float tolerance = 0.0f;
+    std::vector<glm::vec4> texels; // angles along a row, one row per radius
+
+    struct FileHeader {
+        char magic[4]; // "WDLT"
+        uint32_t version;
+        int32_t radii;
+        int32_t angles;
+        float maxRadius;
+        float tolerance;
+    };
+    static const uint32_t FILE_VERSION = 1;
+
+    static float radiusAt(int i, int count, float maxRadius) {
+        float u = (float)i / (float)(count - 1);
+        return 1.0f + (maxRadius - 1.0f) * u * u;
+    }
+
+    // integrates one ray with b = 1 until it leaves the lens sphere moving outward
+    static glm::vec4 integrate(float R, float alpha, float maxRadius, float tolerance) {
+        GeodesicRay ray = {std::sqrt(std::max(R * R - 1.0f, 0.0f)), 0.0f, std::cos(alpha)};
+        float L = R * std::sin(alpha);
+        float lambda = 0.0f;
+        float h = GEODESIC_INITIAL_STEP;
+        GeodesicRay k1 = geodesicDerivatives(ray, L, 1.0f);
+
+        for (int i = 0; i < GEODESIC_MAX_STEPS; ++i) {
+            GeodesicRay k7;
+            float error;
+            GeodesicRay next = dormandPrinceStep(ray, k1, L, h, 1.0f, tolerance, k7, error);
+            if (error > 1.0f && h > GEODESIC_MIN_STEP) {
+                h = std::max(nextStepSize(h, error), GEODESIC_MIN_STEP);
+                continue;
+            }
+
+            float r0 = std::sqrt(ray.l * ray.l + 1.0f);
+            float r1 = std::sqrt(next.l * next.l + 1.0f);
+            if (r1 >= maxRadius && next.l * next.p > 0.0f) {
+                float t = r1 > r0 ? glm::clamp((maxRadius - r0) / (r1 - r0), 0.0f, 1.0f) : 0.0f;
+                return glm::vec4(ray.phi + (next.phi - ray.phi) * t, next.l < 0.0f ? 1.0f : 0.0f, lambda + h * t, 1.0f);
+            }
+
+            lambda += h;
+            ray = next;
+            k1 = k7;
+            h = std::min(nextStepSize(h, error), GEODESIC_MAX_STEP_FRACTION * r1);
+        }
+        return glm::vec4(0.0f); // trapped near the throat
+    }
+
+    void build(float lensRadius, float tol) {
+        radii = DEFLECTION_LUT_RADII;
+        angles = DEFLECTION_LUT_ANGLES;
+        maxRadius = lensRadius;
+        tolerance = tol;
+        texels.assign((size_t)radii * angles, glm::vec4(0.0f));
+
+        #pragma omp parallel for schedule(dynamic)
+        for (int i = 0; i < radii; ++i) {
+            float R = radiusAt(i, radii, maxRadius);
+            for (int j = 0; j < angles; ++j) {
+                float alpha = (float)M_PI * (float)j / (float)(angles - 1);
+                texels[(size_t)i * angles + j] = integrate(R, alpha, maxRadius, tolerance);
+            }
+        }
+    }
+
+    bool load(const std::string& path, float lensRadius, float tol) {
+        FILE* f = fopen(path.c_str(), "rb");
+        if (!f) return false;
+        FileHeader header;
+        bool ok = fread(&header, sizeof(header), 1, f) == 1 && memcmp(header.magic, "WDLT", 4) == 0 &&
+                  header.version == FILE_VERSION && header.radii == DEFLECTION_LUT_RADII &&
+                  header.angles == DEFLECTION_LUT_ANGLES && header.maxRadius == lensRadius &&
+                  header.tolerance == tol;
+        if (ok) {
+            radii = header.radii;
+            angles = header.angles;
+            maxRadius = header.maxRadius;
+            tolerance = header.tolerance;
+            texels.resize((size_t)radii * angles);
+            ok = fread(texels.data(), sizeof(glm::vec4), texels.size(), f) == texels.size();
+        }
+        fclose(f);
+        return ok;
+    }
+
+    bool save(const std::string& path) const {
+        FILE* f = fopen(path.c_str(), "wb");
+        if (!f) return false;
+        FileHeader header;
+        memcpy(header.magic, "WDLT", 4);
+        header.version = FILE_VERSION;
+        header.radii = radii;
+        header.angles = angles;
+        header.maxRadius = maxRadius;
+        header.tolerance = tolerance;
+        bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+                  fwrite(texels.data(), sizeof(glm::vec4), texels.size(), f) == texels.size();
+        fclose(f);
+        return ok;
+    }
+
+    // reads the cached table, or integrates and caches it when it's missing or stale.
+    // returns false if it had to be rebuilt
+    bool loadOrBuild(const std::string& path, float lensRadius, float tol) {
+        if (load(path, lensRadius, tol)) {
+            return true;
+        }
+        build(lensRadius, tol);
+        save(path);
+        return false;
+    }
+
+    // continuous texel coordinates of (R, alpha), matching the texel centers on the gpu
+    glm::vec2 coords(float R, float alpha) const {
+        float u = std::sqrt(glm::clamp((R - 1.0f) / (maxRadius - 1.0f), 0.0f, 1.0f));
+        float a = glm::clamp(alpha / (float)M_PI, 0.0f, 1.0f);
+        return glm::vec2(a * (angles - 1), u * (radii - 1));
+    }
+
+    glm::vec4 sample(float R, float alpha) const {
+        glm::vec2 c = coords(R, alpha);
+        int x0 = std::min((int)c.x, angles - 2);
+        int y0 = std::min((int)c.y, radii - 2);
+        float fx = c.x - x0;
+        float fy = c.y - y0;
+        const glm::vec4* row0 = &texels[(size_t)y0 * angles];
+        const glm::vec4* row1 = row0 + angles;
+        glm::vec4 top = row0[x0] + (row0[x0 + 1] - row0[x0]) * fx;
+        glm::vec4 bottom = row1[x0] + (row1[x0 + 1] - row1[x0]) * fx;
+        return top + (bottom - top) * fy;
+    }
+};
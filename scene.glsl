@@ -0,0 +1,420 @@
+// scene description and ray queries shared by wormhole.comp and geodesic.comp:
+// camera and frame state, the sphere / mesh / bvh / star buffers, intersection,
+// starfield lookup and surface shading. pulled in with #include, which
+// Engine::readShaderFromFile resolves before compiling
+layout(binding = 1) uniform samplerCube starfieldCube;
+
+layout(std140, binding = 0) uniform Camera {
+    vec3 position;
+    float pad1;
+    vec3 target;
+    float pad2;
+    vec3 up;
+    float pad3;
+    float fov;
+} u_camera;
+
+struct Sphere {
+    vec4 centerAndRadius; // .xyz: center, .w: radius
+    vec4 color;           // .xyz: color
+    vec4 properties;      // .x: isEmissive (1.0 or 0.0), .y: universeID
+};
+
+struct Star {
+    vec4 data; // .xyz = direction, .w = brightness
+    vec4 colorAndSize; // .xyz = color, .w = size
+};
+
+layout(std430, binding = 1) buffer SphereBuffer {
+    Sphere spheres[];
+};
+
+layout(std430, binding = 3) buffer StarBuffer {
+    Star stars[];
+};
+
+// indexed mesh: .xyz vertex indices, .w rgb8 color with MESH_EMISSIVE_BIT on top
+layout(std430, binding = 4) buffer TriangleBuffer {
+    uvec4 triangles[];
+};
+
+// vertex positions quantized to 16 bits per axis inside the mesh bounds
+layout(std430, binding = 8) buffer VertexBuffer {
+    uvec2 vertices[];
+};
+
+struct BVHNode {
+    vec3 boundsMin;
+    int leftOrFirst; // inner: index of the left child (right is +1), leaf: first primitive ref
+    vec3 boundsMax;
+    int count;       // 0 for inner nodes
+};
+
+layout(std430, binding = 6) buffer BVHNodeBuffer {
+    BVHNode nodes[];
+};
+
+// high bit set: triangle index, otherwise sphere index
+layout(std430, binding = 7) buffer BVHPrimBuffer {
+    uint primRefs[];
+};
+
+// frame totals of the ray cost counters while a debug view is on: steps, primitives,
+// stars and traced pixels, each as a 64-bit lo / hi pair, cleared by the engine
+layout(std430, binding = 12) buffer CostBuffer {
+    uint costTotals[8];
+};
+
+// per cube-face cell star lists for binned mode: 6 * starCellGrid^2 + 1 offsets,
+// followed by the star indices they point into
+layout(std430, binding = 5) buffer StarCellBuffer {
+    uint starCells[];
+};
+
+#include "frame.glsl"
+
+const float SKY_DISTANCE = 1e6; // hit distance reported for rays that escape to the starfield
+
+const int STARFIELD_EXACT = 0;   // loop over every star, per pixel
+const int STARFIELD_CUBEMAP = 1; // sample the cubemap baked by starfield_bake.comp
+const int STARFIELD_BINNED = 2;  // exact, but only the stars listed in the ray's cell
+
+// compile time variants. Engine::traceDefines puts the matching #defines in front of
+// the shader so the branches it doesn't take compile out; without them a variant falls
+// back to the frame uniform and decides at run time
+#ifndef THROAT_RADIUS
+#define THROAT_RADIUS 25.0 // DEFAULT_THROAT_RADIUS in scene.h; traceDefines passes the one from scene.txt
+#endif
+#ifndef STARFIELD_MODE
+#define STARFIELD_MODE starfieldMode
+#endif
+#ifndef GEODESIC_LUT
+#define GEODESIC_LUT geodesicLut
+#endif
+#ifndef DEBUG_VIEW
+#define DEBUG_VIEW debugView
+#endif
+
+const vec3 THROAT_CENTER = vec3(0, 0, 0);
+
+const int DEBUG_VIEW_NONE = 0;       // must match DebugView in wormhole_sim.cpp
+const int DEBUG_VIEW_STEPS = 1;      // geodesic integration steps, rejected ones included
+const int DEBUG_VIEW_PRIMITIVES = 2; // spheres and triangles intersection tested
+const int DEBUG_VIEW_STARS = 3;      // stars tested by getStarfieldColor
+const float HEATMAP_MAX_COST = 256.0;   // steps or primitives shown at the top of the color scale
+const float HEATMAP_MAX_STARS = 4096.0; // stars shown at the top of the color scale
+
+// ray cost of the current invocation, for the debug views
+uint costSteps = 0u;
+uint costPrimitives = 0u;
+uint costStars = 0u;
+
+const uint BVH_TRIANGLE_BIT = 0x80000000u;
+const uint MESH_EMISSIVE_BIT = 1u << 24;
+const int BVH_STACK_SIZE = 32;
+
+float random(vec2 st) {
+    return fract(sin(dot(st.xy, vec2(12.9898, 78.233))) * 43758.5453123);
+}
+
+float noise(vec2 st) {
+    vec2 i = floor(st);
+    vec2 f = fract(st);
+    float a = random(i);
+    float b = random(i + vec2(1.0, 0.0));
+    float c = random(i + vec2(0.0, 1.0));
+    float d = random(i + vec2(1.0, 1.0));
+    vec2 u = f * f * (3.0 - 2.0 * f);
+    return mix(a, b, u.x) + (c - a) * u.y * (1.0 - u.x) + (d - b) * u.y * u.x;
+}
+
+float fbm(vec2 st) {
+    float value = 0.0;
+    float amplitude = 0.5;
+    float frequency = 0.0;
+    for (int i = 0; i < 6; i++) {
+        value += amplitude * noise(st);
+        st *= 2.0;
+        amplitude *= 0.5;
+    }
+    return value;
+}
+
+struct HitInfo {
+    bool hit;
+    float distance;
+    vec3 normal;
+    vec3 color;
+    int isEmissive;
+    vec3 center;
+    float radius;
+};
+
+HitInfo intersectSphere(vec3 rayOrigin, vec3 rayDir, vec4 centerAndRadius, vec4 color, vec4 properties) {
+    HitInfo hit;
+    hit.hit = false;
+    vec3 oc = rayOrigin - centerAndRadius.xyz;
+    float a = dot(rayDir, rayDir);
+    float b = 2.0 * dot(oc, rayDir);
+    float c = dot(oc, oc) - centerAndRadius.w * centerAndRadius.w;
+    float discriminant = b * b - 4 * a * c;
+
+    if (discriminant >= 0) {
+        float t = (-b - sqrt(discriminant)) / (2.0 * a);
+        if (t > 0.001) {
+            hit.hit = true;
+            hit.distance = t;
+            hit.normal = normalize((rayOrigin + rayDir * t) - centerAndRadius.xyz);
+            hit.color = color.rgb;
+            hit.isEmissive = int(properties.x);
+            hit.center = centerAndRadius.xyz;
+            hit.radius = centerAndRadius.w;
+        }
+    }
+    return hit;
+}
+
+vec3 meshVertex(uint index) {
+    uvec2 q = vertices[index];
+    return meshBoundsMin + vec3(q.x & 0xFFFFu, q.x >> 16, q.y & 0xFFFFu) * meshQuantizeScale;
+}
+
+bool intersectTriangle(vec3 rayOrigin, vec3 rayDir, vec3 v0, vec3 v1, vec3 v2, inout float t) {
+    vec3 edge1 = v1 - v0;
+    vec3 edge2 = v2 - v0;
+    vec3 h = cross(rayDir, edge2);
+    float a = dot(edge1, h);
+
+    if (a > -1e-6 && a < 1e-6)
+        return false;
+
+    float f = 1.0 / a;
+    vec3 s = rayOrigin - v0;
+    float u = f * dot(s, h);
+
+    if (u < 0.0 || u > 1.0)
+        return false;
+
+    vec3 q = cross(s, edge1);
+    float v = f * dot(rayDir, q);
+
+    if (v < 0.0 || u + v > 1.0)
+        return false;
+
+    float current_t = f * dot(edge2, q);
+
+    if (current_t > 1e-6) {
+        t = current_t;
+        return true;
+    }
+    return false;
+}
+
+// entry distance of the ray into the box, or 1e30 if it misses or is beyond maxDist
+float intersectAABB(vec3 origin, vec3 invDir, vec3 boundsMin, vec3 boundsMax, float maxDist) {
+    vec3 t0 = (boundsMin - origin) * invDir;
+    vec3 t1 = (boundsMax - origin) * invDir;
+    vec3 tmin = min(t0, t1);
+    vec3 tmax = max(t0, t1);
+    float tnear = max(max(tmin.x, tmin.y), max(tmin.z, 0.0));
+    float tfar = min(min(tmax.x, tmax.y), tmax.z);
+    return (tnear <= tfar && tnear < maxDist) ? tnear : 1e30;
+}
+
+void intersectPrimitive(vec3 origin, vec3 direction, uint ref, inout HitInfo closestHit) {
+    costPrimitives++;
+    if ((ref & BVH_TRIANGLE_BIT) != 0u) {
+        uvec4 tri = triangles[ref & ~BVH_TRIANGLE_BIT];
+        vec3 v0 = meshVertex(tri.x);
+        vec3 v1 = meshVertex(tri.y);
+        vec3 v2 = meshVertex(tri.z);
+        float t;
+        if (intersectTriangle(origin, direction, v0, v1, v2, t) && t < closestHit.distance) {
+            closestHit.hit = true;
+            closestHit.distance = t;
+            closestHit.normal = normalize(cross(v1 - v0, v2 - v0));
+            closestHit.color = unpackUnorm4x8(tri.w).rgb;
+            closestHit.isEmissive = (tri.w & MESH_EMISSIVE_BIT) != 0u ? 1 : 0;
+            closestHit.center = (v0 + v1 + v2) / 3.0;
+            closestHit.radius = max(length(v0 - closestHit.center), 1e-3);
+        }
+    } else {
+        Sphere sphere = spheres[ref];
+        HitInfo currentHit = intersectSphere(origin, direction, sphere.centerAndRadius, sphere.color, sphere.properties);
+        if (currentHit.hit && currentHit.distance < closestHit.distance) {
+            closestHit = currentHit;
+        }
+    }
+}
+
+// walks the universe's bvh front to back with a short stack, only accepting hits
+// closer than maxDistance
+HitInfo traceSegment(vec3 origin, vec3 direction, int universe, float maxDistance) {
+    HitInfo closestHit;
+    closestHit.hit = false;
+    closestHit.distance = maxDistance;
+
+    int root = (universe == 1) ? bvhRoots.x : bvhRoots.y;
+    if (root < 0) {
+        return closestHit;
+    }
+
+    vec3 invDir = 1.0 / direction;
+    if (intersectAABB(origin, invDir, nodes[root].boundsMin, nodes[root].boundsMax, closestHit.distance) >= 1e30) {
+        return closestHit;
+    }
+
+    int stack[BVH_STACK_SIZE];
+    int sp = 0;
+    int current = root;
+    while (true) {
+        BVHNode node = nodes[current];
+        if (node.count > 0) {
+            for (int i = 0; i < node.count; ++i) {
+                intersectPrimitive(origin, direction, primRefs[node.leftOrFirst + i], closestHit);
+            }
+            if (sp == 0) break;
+            current = stack[--sp];
+            continue;
+        }
+
+        int nearChild = node.leftOrFirst;
+        int farChild = node.leftOrFirst + 1;
+        float tNear = intersectAABB(origin, invDir, nodes[nearChild].boundsMin, nodes[nearChild].boundsMax, closestHit.distance);
+        float tFar = intersectAABB(origin, invDir, nodes[farChild].boundsMin, nodes[farChild].boundsMax, closestHit.distance);
+        if (tFar < tNear) {
+            int tmpIndex = nearChild; nearChild = farChild; farChild = tmpIndex;
+            float tmpDist = tNear; tNear = tFar; tFar = tmpDist;
+        }
+
+        if (tNear >= 1e30) {
+            if (sp == 0) break;
+            current = stack[--sp];
+            continue;
+        }
+        current = nearChild;
+        if (tFar < 1e30 && sp < BVH_STACK_SIZE) {
+            stack[sp++] = farChild;
+        }
+    }
+
+    return closestHit;
+}
+
+HitInfo traceScene(vec3 origin, vec3 direction, int universe) {
+    return traceSegment(origin, direction, universe, 1e10);
+}
+
+vec3 starContribution(int i, vec3 direction) {
+    costStars++;
+    vec3 star_dir = stars[i].data.xyz;
+    float dist = acos(dot(direction, star_dir));
+    
+    float intensity = stars[i].data.w * smoothstep(stars[i].colorAndSize.w, 0.0, dist);
+    
+    if (intensity > 0.0) {
+        return stars[i].colorAndSize.xyz * intensity;
+    }
+    return vec3(0.0);
+}
+
+// cube-face cell of a direction, matching buildStarCells on the cpu
+int starCellIndex(vec3 d) {
+    vec3 a = abs(d);
+    int face;
+    vec2 st;
+    if (a.x >= a.y && a.x >= a.z) {
+        face = d.x >= 0.0 ? 0 : 1;
+        st = d.x >= 0.0 ? vec2(-d.z, -d.y) : vec2(d.z, -d.y);
+        st /= a.x;
+    } else if (a.y >= a.z) {
+        face = d.y >= 0.0 ? 2 : 3;
+        st = d.y >= 0.0 ? vec2(d.x, d.z) : vec2(d.x, -d.z);
+        st /= a.y;
+    } else {
+        face = d.z >= 0.0 ? 4 : 5;
+        st = d.z >= 0.0 ? vec2(d.x, -d.y) : vec2(-d.x, -d.y);
+        st /= a.z;
+    }
+    ivec2 cell = clamp(ivec2((st + 1.0) * 0.5 * float(starCellGrid)), ivec2(0), ivec2(starCellGrid - 1));
+    return (face * starCellGrid + cell.y) * starCellGrid + cell.x;
+}
+
+vec3 getStarfieldColor(vec3 direction) {
+    if (STARFIELD_MODE == STARFIELD_CUBEMAP) {
+        return texture(starfieldCube, direction).rgb;
+    }
+
+    vec3 color = vec3(0.0);
+
+    if (STARFIELD_MODE == STARFIELD_BINNED) {
+        int cell = starCellIndex(direction);
+        uint first = starCells[cell];
+        uint last = starCells[cell + 1];
+        for (uint i = first; i < last; ++i) {
+            color += starContribution(int(starCells[i]), direction);
+        }
+        return color;
+    }
+
+    for(int i = 0; i < numStars; ++i) {
+        color += starContribution(i, direction);
+    }
+    return color;
+}
+
+// dark blue through cyan, green and yellow to red, same stops as heatmapColor in
+// wormhole_geodesic.cpp
+vec3 heatmapColor(float t) {
+    const vec3 stops[5] = vec3[](vec3(0.0, 0.0, 0.4), vec3(0.0, 0.7, 1.0), vec3(0.1, 0.9, 0.2),
+                                 vec3(1.0, 0.9, 0.0), vec3(1.0, 0.1, 0.0));
+    float x = clamp(t, 0.0, 1.0) * 4.0;
+    int i = min(int(x), 3);
+    return mix(stops[i], stops[i + 1], x - float(i));
+}
+
+void addCostTotal(int counter, uint value) {
+    uint old = atomicAdd(costTotals[counter * 2], value);
+    if (old + value < old) {
+        atomicAdd(costTotals[counter * 2 + 1], 1u); // carry into the high word
+    }
+}
+
+// with a debug view on, adds this pixel's counters to the frame totals and returns the
+// selected one as a log scaled heatmap in place of the shaded color
+vec3 applyDebugView(vec3 color) {
+    if (DEBUG_VIEW == DEBUG_VIEW_NONE) {
+        return color;
+    }
+    addCostTotal(0, costSteps);
+    addCostTotal(1, costPrimitives);
+    addCostTotal(2, costStars);
+    addCostTotal(3, 1u);
+
+    uint count = DEBUG_VIEW == DEBUG_VIEW_STEPS ? costSteps : (DEBUG_VIEW == DEBUG_VIEW_PRIMITIVES ? costPrimitives : costStars);
+    float scale = DEBUG_VIEW == DEBUG_VIEW_STARS ? HEATMAP_MAX_STARS : HEATMAP_MAX_COST;
+    return heatmapColor(log2(1.0 + float(count)) / log2(1.0 + scale));
+}
+
+// sun surface noise for emissive hits, phong lit by the universe's sun otherwise
+vec3 shadeHit(HitInfo hit, vec3 origin, vec3 dir, int universe) {
+    vec3 hitPoint = origin + dir * hit.distance;
+    if (hit.isEmissive == 1) {
+        vec3 localPos = hitPoint - hit.center;
+        vec2 uv = vec2(atan(localPos.z, localPos.x) / (2.0 * 3.14159), acos(localPos.y / hit.radius) / 3.14159);
+        float sun_noise = fbm(uv * 10.0 + vec2(time * 0.1, time * 0.05));
+        return hit.color * (0.8 + sun_noise * 0.4);
+    }
+
+    vec3 viewDir = -dir;
+    vec3 sunPos = (universe == 1) ? sunPosU1 : sunPosU2;
+    vec3 lightDir = normalize(sunPos - hitPoint);
+
+    float diffuse = max(0.0, dot(hit.normal, lightDir));
+    vec3 reflectDir = reflect(-lightDir, hit.normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32.0);
+
+    float ambient = 0.3;
+    vec3 sunColor = (universe == 1) ? sunColorU1 : sunColorU2;
+    return hit.color * (ambient + diffuse * 0.7) + sunColor * spec;
+}
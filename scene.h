@@ -0,0 +1,386 @@
+#pragma once
+
+// scene.txt, the scene shared by wormhole_sim.cpp and wormhole_geodesic.cpp. every
+// non-comment line is one of
+//   throat radius
+//   sun universe x y z radius r g b      the emissive sphere lighting that universe
+//   sphere universe x y z radius r g b   a planet
+//   stars count                          a random catalog of that many stars
+//   star_catalog file                    stars listed one per line as x y z brightness r g b size
+//   mesh file.obj scale x y z            a triangle mesh in universe 1, gpu renderer only
+// files are relative to the scene. the parsed scene is cached next to it as a .wscene
+// file that holds the spheres and stars in the std430 layout of the gpu buffers, so the
+// next load maps it and the arrays can be copied into the buffers as they are
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <filesystem>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+
+const float DEFAULT_THROAT_RADIUS = 25.0f;
+const uint32_t SCENE_CACHE_MAGIC = 0x4e435357; // "WSCN"
+const uint32_t SCENE_CACHE_VERSION = 1;
+const size_t SCENE_PATH_SIZE = 256;
+
+// same layout as Sphere in scene.glsl
+struct SceneSphere {
+    float centerAndRadius[4];
+    float color[4];      // .a unused
+    float properties[4]; // .x: 1 for emissive, .y: universe
+};
+
+// same layout as Star in scene.glsl
+struct SceneStar {
+    float data[4];         // .xyz: direction, .w: brightness
+    float colorAndSize[4];
+};
+
+struct SceneMesh {
+    char path[SCENE_PATH_SIZE];
+    float scale;
+    float offset[3];
+};
+
+struct SceneCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t sourceSize;   // scene.txt the cache was built from
+    int64_t sourceTime;
+    char catalogPath[SCENE_PATH_SIZE]; // and its star catalog, empty without one
+    uint64_t catalogSize;
+    int64_t catalogTime;
+    float throatRadius;
+    int32_t sunIndex[2];   // sphere lighting universe 1 and 2, -1 for none
+    uint32_t numSpheres;
+    uint32_t numStars;
+    uint32_t numMeshes;
+    uint64_t spheresOffset; // from the start of the file, 16 byte aligned
+    uint64_t starsOffset;
+    uint64_t meshesOffset;
+};
+
+// a read-only view of a whole file
+struct MappedFile {
+    const char* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { close(); }
+
+    bool open(const std::string& path) {
+        close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER length;
+        if (!GetFileSizeEx(file, &length) || length.QuadPart == 0) {
+            close();
+            return false;
+        }
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        data = mapping ? (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        size = (size_t)length.QuadPart;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                data = (const char*)p;
+                size = (size_t)st.st_size;
+            }
+        }
+        ::close(fd); // the mapping stays valid
+#endif
+        if (!data) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (data) UnmapViewOfFile(data);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (data) munmap((void*)data, size);
+#endif
+        data = nullptr;
+        size = 0;
+    }
+};
+
+// a run of records inside the scene image
+template <typename T>
+struct SceneArray {
+    const T* items = nullptr;
+    size_t count = 0;
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    const T& operator[](size_t i) const { return items[i]; }
+    const T* begin() const { return items; }
+    const T* end() const { return items + count; }
+};
+
+// a loaded scene. the arrays point into the mapped cache, or into image when the cache
+// couldn't be written
+struct Scene {
+    float throatRadius = DEFAULT_THROAT_RADIUS;
+    int sunIndex[2] = {-1, -1};
+    SceneArray<SceneSphere> spheres;
+    SceneArray<SceneStar> stars;
+    SceneArray<SceneMesh> meshes;
+    bool cached = false; // loaded from the .wscene cache
+
+    MappedFile file;
+    std::vector<char> image;
+
+    Scene() = default;
+    Scene(const Scene&) = delete;
+    Scene& operator=(const Scene&) = delete;
+};
+
+// random directions, brightnesses, sizes and tints, drawn from rand in the same order
+// wormhole_sim always has, so srand(1) keeps giving the benchmark the same sky
+inline void generateStarCatalog(int count, std::vector<SceneStar>& out) {
+    for (int i = 0; i < count; i++) {
+        float x = (rand() / (float)RAND_MAX) * 2.0f - 1.0f;
+        float y = (rand() / (float)RAND_MAX) * 2.0f - 1.0f;
+        float z = (rand() / (float)RAND_MAX) * 2.0f - 1.0f;
+        float length = std::sqrt(x * x + y * y + z * z);
+        float brightness = (rand() / (float)RAND_MAX) * 0.5f + 0.5f;
+        float size = (rand() / (float)RAND_MAX) * 0.005f + 0.001f;
+
+        float temp = (rand() / (float)RAND_MAX);
+        float r = 1.0f, g = 1.0f, b = 1.0f; // white
+        if (temp < 0.33f) {
+            r = g = 0.8f;                   // bluish
+        } else if (temp >= 0.66f) {
+            b = 0.8f;                       // yellowish
+        }
+
+        out.push_back({{x / length, y / length, z / length, brightness}, {r, g, b, size}});
+    }
+}
+
+inline bool sceneFileStamp(const std::string& path, uint64_t& size, int64_t& time) {
+    std::error_code ec;
+    size = std::filesystem::file_size(path, ec);
+    if (ec) return false;
+    time = (int64_t)std::filesystem::last_write_time(path, ec).time_since_epoch().count();
+    return !ec;
+}
+
+inline bool loadStarCatalog(const std::string& path, std::vector<SceneStar>& out) {
+    std::ifstream in(path);
+    if (!in.is_open()) return false;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream ss(line);
+        SceneStar s = {};
+        if (!(ss >> s.data[0] >> s.data[1] >> s.data[2] >> s.data[3] >> s.colorAndSize[0] >> s.colorAndSize[1] >>
+              s.colorAndSize[2] >> s.colorAndSize[3])) {
+            continue;
+        }
+        float length = std::sqrt(s.data[0] * s.data[0] + s.data[1] * s.data[1] + s.data[2] * s.data[2]);
+        if (length <= 0.0f) continue;
+        for (int c = 0; c < 3; ++c) s.data[c] /= length;
+        out.push_back(s);
+    }
+    return true;
+}
+
+// fills header and the record arrays from the text scene, false with a message on errors
+inline bool parseScene(const std::string& path, SceneCacheHeader& header, std::vector<SceneSphere>& spheres,
+                       std::vector<SceneStar>& stars, std::vector<SceneMesh>& meshes) {
+    std::ifstream in(path);
+    if (!in.is_open()) {
+        std::cerr << "error: could not open scene " << path << "\n";
+        return false;
+    }
+    std::filesystem::path dir = std::filesystem::path(path).parent_path();
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(in, line)) {
+        lineNumber++;
+        std::istringstream ss(line);
+        std::string keyword;
+        if (!(ss >> keyword) || keyword[0] == '#') continue;
+
+        bool ok = true;
+        if (keyword == "throat") {
+            ok = (bool)(ss >> header.throatRadius) && header.throatRadius > 0.0f;
+        } else if (keyword == "sun" || keyword == "sphere") {
+            int universe = 0;
+            float x, y, z, radius, r, g, b;
+            ok = (bool)(ss >> universe >> x >> y >> z >> radius >> r >> g >> b) && (universe == 1 || universe == 2);
+            if (ok) {
+                bool sun = keyword == "sun";
+                if (sun) {
+                    header.sunIndex[universe - 1] = (int32_t)spheres.size();
+                }
+                spheres.push_back({{x, y, z, radius}, {r, g, b, 1.0f}, {sun ? 1.0f : 0.0f, (float)universe, 0.0f, 0.0f}});
+            }
+        } else if (keyword == "stars") {
+            int count = 0;
+            ok = (bool)(ss >> count) && count >= 0;
+            if (ok) {
+                stars.clear();
+                header.catalogPath[0] = '\0';
+                generateStarCatalog(count, stars);
+            }
+        } else if (keyword == "star_catalog") {
+            std::string file;
+            ok = (bool)(ss >> file);
+            std::string catalog = (dir / file).string();
+            stars.clear();
+            if (ok && (catalog.size() >= SCENE_PATH_SIZE || !sceneFileStamp(catalog, header.catalogSize, header.catalogTime) ||
+                       !loadStarCatalog(catalog, stars))) {
+                std::cerr << "error: could not read star catalog " << catalog << "\n";
+                return false;
+            }
+            if (ok) {
+                memcpy(header.catalogPath, catalog.c_str(), catalog.size() + 1);
+            }
+        } else if (keyword == "mesh") {
+            std::string file;
+            SceneMesh m = {};
+            ok = (bool)(ss >> file >> m.scale >> m.offset[0] >> m.offset[1] >> m.offset[2]);
+            std::string resolved = (dir / file).string();
+            if (ok && resolved.size() >= SCENE_PATH_SIZE) {
+                std::cerr << "error: mesh path too long in " << path << " line " << lineNumber << "\n";
+                return false;
+            }
+            if (ok) {
+                memcpy(m.path, resolved.c_str(), resolved.size() + 1);
+                meshes.push_back(m);
+            }
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            std::cerr << "error: can't parse " << path << " line " << lineNumber << ": " << line << "\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+inline uint64_t alignSceneOffset(uint64_t offset) {
+    return (offset + 15) & ~(uint64_t)15;
+}
+
+// points the scene's arrays into an image laid out as described by its header
+inline bool bindSceneImage(Scene& scene, const char* data, size_t size) {
+    if (size < sizeof(SceneCacheHeader)) return false;
+    SceneCacheHeader h;
+    memcpy(&h, data, sizeof(h));
+    if (h.spheresOffset + (uint64_t)h.numSpheres * sizeof(SceneSphere) > size ||
+        h.starsOffset + (uint64_t)h.numStars * sizeof(SceneStar) > size ||
+        h.meshesOffset + (uint64_t)h.numMeshes * sizeof(SceneMesh) > size) {
+        return false;
+    }
+    scene.throatRadius = h.throatRadius;
+    scene.sunIndex[0] = h.sunIndex[0];
+    scene.sunIndex[1] = h.sunIndex[1];
+    scene.spheres = {(const SceneSphere*)(data + h.spheresOffset), h.numSpheres};
+    scene.stars = {(const SceneStar*)(data + h.starsOffset), h.numStars};
+    scene.meshes = {(const SceneMesh*)(data + h.meshesOffset), h.numMeshes};
+    return true;
+}
+
+// the cache is only valid for the exact scene and star catalog it was built from
+inline bool sceneCacheValid(const SceneCacheHeader& h, uint64_t srcSize, int64_t srcTime) {
+    if (h.magic != SCENE_CACHE_MAGIC || h.version != SCENE_CACHE_VERSION || h.sourceSize != srcSize || h.sourceTime != srcTime) {
+        return false;
+    }
+    if (h.catalogPath[0] == '\0') {
+        return true;
+    }
+    uint64_t size = 0;
+    int64_t time = 0;
+    std::string catalog(h.catalogPath, strnlen(h.catalogPath, SCENE_PATH_SIZE));
+    return sceneFileStamp(catalog, size, time) && size == h.catalogSize && time == h.catalogTime;
+}
+
+// maps path's .wscene cache when it's up to date, otherwise parses the scene and writes
+// the cache for next time
+inline bool loadScene(const std::string& path, Scene& scene) {
+    uint64_t srcSize = 0;
+    int64_t srcTime = 0;
+    if (!sceneFileStamp(path, srcSize, srcTime)) {
+        std::cerr << "error: scene file not found: " << path << "\n";
+        return false;
+    }
+
+    std::string cachePath = path + ".wscene";
+    if (scene.file.open(cachePath) && scene.file.size >= sizeof(SceneCacheHeader)) {
+        SceneCacheHeader h;
+        memcpy(&h, scene.file.data, sizeof(h));
+        if (sceneCacheValid(h, srcSize, srcTime) && bindSceneImage(scene, scene.file.data, scene.file.size)) {
+            scene.cached = true;
+            return true;
+        }
+    }
+    scene.file.close();
+
+    SceneCacheHeader h = {};
+    h.magic = SCENE_CACHE_MAGIC;
+    h.version = SCENE_CACHE_VERSION;
+    h.sourceSize = srcSize;
+    h.sourceTime = srcTime;
+    h.throatRadius = DEFAULT_THROAT_RADIUS;
+    h.sunIndex[0] = h.sunIndex[1] = -1;
+    std::vector<SceneSphere> spheres;
+    std::vector<SceneStar> stars;
+    std::vector<SceneMesh> meshes;
+    if (!parseScene(path, h, spheres, stars, meshes)) {
+        return false;
+    }
+    h.numSpheres = (uint32_t)spheres.size();
+    h.numStars = (uint32_t)stars.size();
+    h.numMeshes = (uint32_t)meshes.size();
+    h.spheresOffset = alignSceneOffset(sizeof(h));
+    h.starsOffset = alignSceneOffset(h.spheresOffset + spheres.size() * sizeof(SceneSphere));
+    h.meshesOffset = alignSceneOffset(h.starsOffset + stars.size() * sizeof(SceneStar));
+
+    scene.image.assign(h.meshesOffset + meshes.size() * sizeof(SceneMesh), 0);
+    memcpy(scene.image.data(), &h, sizeof(h));
+    if (!spheres.empty()) memcpy(scene.image.data() + h.spheresOffset, spheres.data(), spheres.size() * sizeof(SceneSphere));
+    if (!stars.empty()) memcpy(scene.image.data() + h.starsOffset, stars.data(), stars.size() * sizeof(SceneStar));
+    if (!meshes.empty()) memcpy(scene.image.data() + h.meshesOffset, meshes.data(), meshes.size() * sizeof(SceneMesh));
+
+    std::ofstream out(cachePath, std::ios::binary);
+    if (out.is_open()) {
+        out.write(scene.image.data(), (std::streamsize)scene.image.size());
+    }
+    return bindSceneImage(scene, scene.image.data(), scene.image.size());
+}
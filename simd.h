@@ -0,0 +1,72 @@
+#pragma once
+
+// minimal portable float vector for the cpu packet tracer in wormhole_geodesic.cpp.
+// with AVX enabled (-mavx2, /arch:AVX2) it maps onto __m256, otherwise onto a plain
+// array whose loops the optimizer is free to vectorize for whatever the target has.
+// only the arithmetic the geodesic integrator needs is here
+
+#include <cmath>
+#include <algorithm>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define SIMD_AVX 1
+#endif
+
+const int SIMD_WIDTH = 8; // rays per packet
+
+struct FloatN {
+#ifdef SIMD_AVX
+    __m256 v;
+
+    FloatN() = default;
+    FloatN(__m256 x) : v(x) {}
+    FloatN(float s) : v(_mm256_set1_ps(s)) {}
+
+    static FloatN load(const float* p) { return _mm256_load_ps(p); }
+    void store(float* p) const { _mm256_store_ps(p, v); }
+#else
+    float v[SIMD_WIDTH];
+
+    FloatN() = default;
+    FloatN(float s) {
+        for (int i = 0; i < SIMD_WIDTH; ++i) v[i] = s;
+    }
+
+    static FloatN load(const float* p) {
+        FloatN r;
+        for (int i = 0; i < SIMD_WIDTH; ++i) r.v[i] = p[i];
+        return r;
+    }
+    void store(float* p) const {
+        for (int i = 0; i < SIMD_WIDTH; ++i) p[i] = v[i];
+    }
+#endif
+};
+
+#ifdef SIMD_AVX
+inline FloatN operator+(const FloatN& a, const FloatN& b) { return _mm256_add_ps(a.v, b.v); }
+inline FloatN operator-(const FloatN& a, const FloatN& b) { return _mm256_sub_ps(a.v, b.v); }
+inline FloatN operator*(const FloatN& a, const FloatN& b) { return _mm256_mul_ps(a.v, b.v); }
+inline FloatN operator/(const FloatN& a, const FloatN& b) { return _mm256_div_ps(a.v, b.v); }
+inline FloatN sqrt(const FloatN& a) { return _mm256_sqrt_ps(a.v); }
+inline FloatN abs(const FloatN& a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v); }
+inline FloatN min(const FloatN& a, const FloatN& b) { return _mm256_min_ps(a.v, b.v); }
+inline FloatN max(const FloatN& a, const FloatN& b) { return _mm256_max_ps(a.v, b.v); }
+#else
+#define SIMD_LANEWISE(expr)                          \
+    FloatN r;                                        \
+    for (int i = 0; i < SIMD_WIDTH; ++i) r.v[i] = expr; \
+    return r;
+
+inline FloatN operator+(const FloatN& a, const FloatN& b) { SIMD_LANEWISE(a.v[i] + b.v[i]) }
+inline FloatN operator-(const FloatN& a, const FloatN& b) { SIMD_LANEWISE(a.v[i] - b.v[i]) }
+inline FloatN operator*(const FloatN& a, const FloatN& b) { SIMD_LANEWISE(a.v[i] * b.v[i]) }
+inline FloatN operator/(const FloatN& a, const FloatN& b) { SIMD_LANEWISE(a.v[i] / b.v[i]) }
+inline FloatN sqrt(const FloatN& a) { SIMD_LANEWISE(std::sqrt(a.v[i])) }
+inline FloatN abs(const FloatN& a) { SIMD_LANEWISE(std::abs(a.v[i])) }
+inline FloatN min(const FloatN& a, const FloatN& b) { SIMD_LANEWISE(std::min(a.v[i], b.v[i])) }
+inline FloatN max(const FloatN& a, const FloatN& b) { SIMD_LANEWISE(std::max(a.v[i], b.v[i])) }
+
+#undef SIMD_LANEWISE
+#endif
@@ -0,0 +1,152 @@
+#pragma once
+
+// minimal blocking tcp sockets for the distributed geodesic renderer, on winsock or
+// bsd sockets. a Socket is a plain handle like the gl objects elsewhere, it has to be
+// closed explicitly
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <csignal>
+#endif
+
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+
+struct Socket {
+#ifdef _WIN32
+    typedef SOCKET Handle;
+    static constexpr Handle INVALID_HANDLE = INVALID_SOCKET;
+#else
+    typedef int Handle;
+    static constexpr Handle INVALID_HANDLE = -1;
+#endif
+    Handle handle = INVALID_HANDLE;
+
+    // once per process, before any other call
+    static bool initialize() {
+#ifdef _WIN32
+        WSADATA data;
+        return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+#else
+        signal(SIGPIPE, SIG_IGN); // a vanished peer should fail the send, not kill the process
+        return true;
+#endif
+    }
+
+    bool valid() const { return handle != INVALID_HANDLE; }
+
+    static Socket listen(int port) {
+        Socket s;
+        s.handle = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (!s.valid()) return s;
+        int reuse = 1;
+        setsockopt(s.handle, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address.sin_port = htons((uint16_t)port);
+        if (::bind(s.handle, (sockaddr*)&address, sizeof(address)) != 0 || ::listen(s.handle, SOMAXCONN) != 0) {
+            s.close();
+        }
+        return s;
+    }
+
+    Socket accept() const {
+        Socket s;
+        s.handle = ::accept(handle, nullptr, nullptr);
+        s.setNoDelay();
+        return s;
+    }
+
+    static Socket connect(const std::string& host, int port) {
+        Socket s;
+        addrinfo hints = {};
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* result = nullptr;
+        if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &result) != 0) {
+            return s;
+        }
+        for (addrinfo* a = result; a && !s.valid(); a = a->ai_next) {
+            s.handle = ::socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+            if (s.valid() && ::connect(s.handle, a->ai_addr, (int)a->ai_addrlen) != 0) {
+                s.close();
+            }
+        }
+        freeaddrinfo(result);
+        s.setNoDelay();
+        return s;
+    }
+
+    // sends and receives fail once the peer has been silent for this long
+    void setTimeout(int seconds) {
+#ifdef _WIN32
+        DWORD timeout = (DWORD)seconds * 1000;
+#else
+        timeval timeout = {seconds, 0};
+#endif
+        setsockopt(handle, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+        setsockopt(handle, SOL_SOCKET, SO_SNDTIMEO, (const char*)&timeout, sizeof(timeout));
+    }
+
+    void setNoDelay() {
+        if (valid()) {
+            int on = 1;
+            setsockopt(handle, IPPROTO_TCP, TCP_NODELAY, (const char*)&on, sizeof(on));
+        }
+    }
+
+    bool sendAll(const void* data, size_t size) const {
+        const char* p = (const char*)data;
+        while (size > 0) {
+            int sent = (int)::send(handle, p, (int)std::min(size, (size_t)1 << 20), 0);
+            if (sent <= 0) return false;
+            p += sent;
+            size -= (size_t)sent;
+        }
+        return true;
+    }
+
+    bool recvAll(void* data, size_t size) const {
+        char* p = (char*)data;
+        while (size > 0) {
+            int received = (int)::recv(handle, p, (int)std::min(size, (size_t)1 << 20), 0);
+            if (received <= 0) return false;
+            p += received;
+            size -= (size_t)received;
+        }
+        return true;
+    }
+
+    // wakes up a thread blocked in recv on this socket, which stays open until close
+    void shutdown() const {
+        if (!valid()) return;
+#ifdef _WIN32
+        ::shutdown(handle, SD_BOTH);
+#else
+        ::shutdown(handle, SHUT_RDWR);
+#endif
+    }
+
+    // also wakes up a thread blocked in accept or recv on this socket
+    void close() {
+        if (!valid()) return;
+        shutdown();
+#ifdef _WIN32
+        ::closesocket(handle);
+#else
+        ::close(handle);
+#endif
+        handle = INVALID_HANDLE;
+    }
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+// single producer, single consumer handoff of the latest value between two threads,
+// without locks. the writer always has a slot of its own to fill, the reader always
+// has the last one it took, and the third sits in between holding the newest published
+// value. publishing and taking are one atomic exchange each, so neither side ever waits
+// for the other, and a value the reader never got to is simply overwritten
+
+#include <atomic>
+
+template <typename T>
+struct TripleBuffer {
+    static constexpr int INDEX_MASK = 3;
+    static constexpr int FRESH_BIT = 4; // set in middle while it holds a value the reader hasn't taken
+
+    T slots[3];
+    std::atomic<int> middle{1};
+    int writing = 0; // only touched by the writer
+    int reading = 2; // only touched by the reader
+
+    // writer side: fill this, then publish it
+    T& writeSlot() { return slots[writing]; }
+
+    void publish() {
+        writing = middle.exchange(writing | FRESH_BIT, std::memory_order_acq_rel) & INDEX_MASK;
+    }
+
+    // reader side: the newest published value, or the previous one again when nothing
+    // new came in since
+    const T& latest() {
+        if (middle.load(std::memory_order_relaxed) & FRESH_BIT) {
+            reading = middle.exchange(reading, std::memory_order_acq_rel) & INDEX_MASK;
+        }
+        return slots[reading];
+    }
+
+    // before the threads start: every slot holds value, so the reader sees it right away
+    void reset(const T& value) {
+        for (T& slot : slots) slot = value;
+        middle.store(1, std::memory_order_relaxed);
+        writing = 0;
+        reading = 2;
+    }
+};
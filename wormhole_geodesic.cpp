@@ -1,4 +1,5 @@
 #ifdef _WIN32
+#include <winsock2.h> // before windows.h, which would pull in the old winsock
 #include <windows.h>
 #endif
 
@@ -11,6 +12,12 @@
 #include <chrono>
 #include <iomanip>
 #include <filesystem>
+#include <thread>
+#include <mutex>
+#include <deque>
+#include <atomic>
+#include <memory>
+#include <condition_variable>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -28,18 +35,37 @@
 #define M_PI 3.14159265358979323846
 #endif
 
+#include "geodesic.h"
+#include "simd.h"
+#include "camera_path.h"
+#include "socket.h"
+#include "bench.h"
+#include "scene.h"
+#include "frame_writer.h"
+
 using namespace glm;
 using namespace std;
 
 //------------------------------------------------------------------------------
 // constants
 //------------------------------------------------------------------------------
-const int WIDTH = 800;
-const int HEIGHT = 600;
+const int DEFAULT_WIDTH = 800;  // override with --width / --height
+const int DEFAULT_HEIGHT = 600;
 const int SAMPLES_PER_PIXEL = 4; // 2x2 supersampling for antialiasing
+const int TILE_SIZE = 16;        // pixels per tile edge handed to a render thread
+const int PATH_FPS = 24;         // frames per second of camera_path.txt in distributed mode
+const int JOB_TILE_SIZE = 256;   // pixels per tile edge handed to a distributed worker
+const int WORKER_TIMEOUT_SECONDS = 600;   // a worker silent for this long is dropped and its job redone
+const int WORKER_CONNECT_ATTEMPTS = 30;   // one per second, so workers may start before the coordinator
+const float STRAGGLER_FACTOR = 3.0f;      // a job running this many times the average gets a second worker
+const int DEFAULT_FAN_RAYS = 8192;        // integrated angles per camera radius in path mode, override with --fan
+const float FAN_RADIUS_TOLERANCE = 1e-4f; // relative camera radius change below which a frame reuses the last fan
+const int BENCH_WARMUP_FRAMES = 1;        // unmeasured frames per --bench scene
+const int DEFAULT_BENCH_FRAMES = 8;       // measured frames per --bench scene, override with --bench-frames
 
-const float THROAT_RADIUS = 25.0f;
 const vec3 THROAT_CENTER = vec3(0, 0, 0);
+const float LENS_RADIUS = 3.0f; // lens sphere of the --lut table in throat radii, just inside the camera
+const float DEFAULT_FLAT_SPACE_FACTOR = GEODESIC_ESCAPE_FACTOR; // override with --flat-radius
 
 //------------------------------------------------------------------------------
 // camera
@@ -51,6 +77,27 @@ struct Camera {
     float fov;
 };
 
+// the camera's ray basis, set up once per frame instead of once per sample
+struct CameraBasis {
+    vec3 forward, right, up;
+    float aspect, tanHalfFov;
+
+    CameraBasis(const Camera& camera, int width, int height) {
+        forward = normalize(camera.target - camera.position);
+        right = normalize(cross(forward, camera.up));
+        up = cross(right, forward);
+        aspect = (float)width / (float)height;
+        tanHalfFov = tan(radians(camera.fov) * 0.5f);
+    }
+
+    // u, v in [0, 1] across the image, v pointing down
+    vec3 rayDirection(float u, float v) const {
+        float Px = (2.0f * u - 1.0f) * aspect * tanHalfFov;
+        float Py = (1.0f - 2.0f * v) * tanHalfFov;
+        return normalize(Px * right + Py * up + forward);
+    }
+};
+
 //------------------------------------------------------------------------------
 // scene objects
 //------------------------------------------------------------------------------
@@ -60,26 +107,27 @@ struct Sphere {
     vec3 color;
     bool isEmissive;
     int universeID;
+    float shellInner = 0.0f; // radial extent around the throat, set by updateSphereShells
+    float shellOuter = 0.0f;
 };
 
 vector<Sphere> spheres;
+float throatRadius = DEFAULT_THROAT_RADIUS; // from the scene file
+int sunIndex[2] = {-1, -1};                 // sphere lighting each universe, -1 for none
+
+// a ray segment only has to be tested against the spheres whose shell overlaps the
+// range of distances to the throat it covers
+void updateSphereShells() {
+    for (auto& sphere : spheres) {
+        float distance = length(sphere.center - THROAT_CENTER);
+        sphere.shellInner = std::max(distance - sphere.radius, 0.0f);
+        sphere.shellOuter = distance + sphere.radius;
+    }
+}
 
 //------------------------------------------------------------------------------
 // physics and ray tracing
 //------------------------------------------------------------------------------
-struct GeodesicRay {
-    vec3 pos; // cartesian position
-    vec3 dir; // cartesian direction
-    int universe;
-
-    // state for RK4 integrator (cylindrical coordinates for wormhole metric)
-    float l;  // proper radial distance
-    float rho; // cylindrical radius sqrt(x^2 + z^2)
-    float phi; // cylindrical angle
-    
-    vec3 momentum; // p_l, p_rho, p_phi
-};
-
 struct HitInfo {
     bool hit;
     float distance;
@@ -88,14 +136,34 @@ struct HitInfo {
     bool isEmissive;
 };
 
-// Simplified ray-sphere intersection for objects (not for wormhole)
-HitInfo intersectScene(const vec3& origin, const vec3& direction, int universe) {
+// ray cost counters for --bench and --heatmap: dormand-prince steps taken, accepted or
+// not, and spheres intersection tested. every render thread counts into its own
+// thread counters and adds them to the totals when it's done
+std::atomic<uint64_t> integrationSteps{0};
+std::atomic<uint64_t> primitivesTested{0};
+thread_local uint64_t threadSteps = 0;
+thread_local uint64_t threadPrimitives = 0;
+
+// what --heatmap writes instead of the color
+enum DebugView { DEBUG_VIEW_NONE, DEBUG_VIEW_STEPS, DEBUG_VIEW_PRIMITIVES };
+DebugView debugView = DEBUG_VIEW_NONE;
+const float HEATMAP_MAX_COST = 256.0f; // steps or primitives per sample at the top of the color scale
+
+// Simplified ray-sphere intersection for objects (not for wormhole), direction must be normalized
+HitInfo intersectScene(const vec3& origin, const vec3& direction, int universe, float maxDistance = 1e10f) {
     HitInfo closestHit;
     closestHit.hit = false;
-    closestHit.distance = 1e10;
+    closestHit.distance = maxDistance;
+
+    // distances to the throat the segment covers
+    vec3 offset = origin - THROAT_CENTER;
+    float closest = glm::clamp(-dot(offset, direction), 0.0f, maxDistance);
+    float segmentInner = length(offset + direction * closest);
+    float segmentOuter = std::max(length(offset), length(offset + direction * maxDistance));
 
     for (const auto& sphere : spheres) {
-        if (sphere.universeID == universe) {
+        if (sphere.universeID == universe && sphere.shellOuter >= segmentInner && sphere.shellInner <= segmentOuter) {
+            threadPrimitives++;
             vec3 oc = origin - sphere.center;
             float a = dot(direction, direction);
             float b = 2.0f * dot(oc, direction);
@@ -117,175 +185,1260 @@ HitInfo intersectScene(const vec3& origin, const vec3& direction, int universe)
     return closestHit;
 }
 
-// convert cartesian coordinates to cylindrical for the wormhole metric
-void cartesianToCylindrical(const vec3& pos, float& l, float& rho, float& phi) {
-    rho = sqrt(pos.x * pos.x + pos.z * pos.z);
-    phi = atan2(pos.z, pos.x);
-    // for the Morris-Thorne metric, l is defined by this integral,
-    // but we can approximate it or use it as a measure of progress.
-    // here, we'll use y as the equivalent of 'l' for simplicity,
-    // assuming the wormhole is aligned along the y-axis.
-    l = pos.y;
+vec3 shadeHit(const HitInfo& hit, const vec3& origin, const vec3& direction, int universe) {
+    if (hit.isEmissive) {
+        return hit.color;
+    }
+    // simple lambertian lighting
+    int sun = sunIndex[universe == 1 ? 0 : 1];
+    if (sun < 0) {
+        return hit.color * 0.2f;
+    }
+    vec3 sunPos = spheres[sun].center;
+    vec3 lightDir = normalize(sunPos - (origin + direction * hit.distance));
+    float diffuse = std::max(0.0f, dot(hit.normal, lightDir));
+    return hit.color * (0.2f + 0.8f * diffuse);
 }
 
-vec3 cylindricalToCartesian(float l, float rho, float phi) {
-    return vec3(rho * cos(phi), l, rho * sin(phi));
+float geodesicTolerance = DEFAULT_GEODESIC_TOLERANCE;
+float flatSpaceFactor = DEFAULT_FLAT_SPACE_FACTOR; // radius in throat radii past which rays go straight
+bool useTable = false;  // --lut, trace through the deflection table
+bool usePackets = true; // integrate in SIMD packets, --no-packets for one ray at a time
+bool halfPixels = false; // --hdr, images are unclamped rgba halfs instead of rgb8
+DeflectionTable deflectionTable;
+
+vec3 traceStraight(const vec3& origin, const vec3& direction, int universe) {
+    HitInfo hit = intersectScene(origin, direction, universe);
+    if (hit.hit) {
+        return shadeHit(hit, origin, direction, universe);
+    }
+    return vec3(0.0, 0.0, 0.0); // pitch black space
 }
 
-// calculates the derivatives for the geodesic equations (the core of the physics)
-GeodesicRay derivatives(const GeodesicRay& ray) {
-    GeodesicRay derivs;
-    float r = sqrt(ray.l * ray.l + THROAT_RADIUS * THROAT_RADIUS);
-    
-    // these are derived from the christoffel symbols for the morris-thorne metric
-    derivs.pos.x = ray.momentum.x;
-    derivs.pos.y = ray.momentum.y;
-    derivs.pos.z = ray.momentum.z;
-
-    float r3 = r * r * r;
-    derivs.momentum.x = -(THROAT_RADIUS * THROAT_RADIUS * ray.l / r3) * ray.pos.x;
-    derivs.momentum.y = -(THROAT_RADIUS * THROAT_RADIUS * ray.l / r3) * ray.pos.y;
-    derivs.momentum.z = -(THROAT_RADIUS * THROAT_RADIUS * ray.l / r3) * ray.pos.z;
-    
-    return derivs;
+// in flat space the ray is a straight line until it reaches the flat radius, and if it
+// never does the whole ray is one analytic intersection. returns true with the final
+// color in that case, otherwise moves pos up to where the integration has to start
+bool traceFlatApproach(const vec3& origin, const vec3& direction, int universe, vec3& pos, vec3& color) {
+    pos = origin;
+    float flatRadius = flatSpaceFactor * throatRadius;
+    vec3 offset = origin - THROAT_CENTER;
+    if (length(offset) > flatRadius) {
+        float half_b = dot(offset, direction);
+        float discriminant = half_b * half_b - (dot(offset, offset) - flatRadius * flatRadius);
+        if (half_b >= 0.0f || discriminant <= 0.0f) {
+            color = traceStraight(origin, direction, universe);
+            return true;
+        }
+        float t = -half_b - sqrt(discriminant);
+        HitInfo hit = intersectScene(origin, direction, universe, t);
+        if (hit.hit) {
+            color = shadeHit(hit, origin, direction, universe);
+            return true;
+        }
+        pos = origin + direction * t;
+    }
+    return false;
 }
 
 // this is the heart of the new physics engine
 vec3 traceRay(const vec3& origin, const vec3& direction) {
-    // first, check for simple intersections in the local universe
-    HitInfo sceneHit = intersectScene(origin, direction, 1);
-    
-    GeodesicRay geoRay;
-    geoRay.pos = origin;
-    geoRay.dir = direction;
-    geoRay.universe = 1;
-    geoRay.momentum = direction; // initial momentum is just the direction
-
-    const float step_size = 0.5f;
-    const int max_steps = 1000;
-
-    for (int i = 0; i < max_steps; ++i) {
-        // check for intersection before taking a step
-        HitInfo hit = intersectScene(geoRay.pos, normalize(geoRay.momentum), geoRay.universe);
-        if (hit.hit && hit.distance < step_size * 2.0f) {
-            if (hit.isEmissive) {
-                return hit.color;
+    vec3 pos;
+    vec3 dir = direction;
+    int universe = 1;
+    vec3 color;
+    if (traceFlatApproach(origin, direction, universe, pos, color)) {
+        return color;
+    }
+    float flatRadius = flatSpaceFactor * throatRadius;
+
+    GeodesicPlane plane(pos, dir, THROAT_CENTER, throatRadius, universe);
+    GeodesicRay geoRay = plane.start;
+
+    float h = GEODESIC_INITIAL_STEP;
+    GeodesicRay k1 = geodesicDerivatives(geoRay, plane.L, throatRadius);
+    for (int i = 0; i < GEODESIC_MAX_STEPS; ++i) {
+        GeodesicRay k7;
+        float error;
+        GeodesicRay next = dormandPrinceStep(geoRay, k1, plane.L, h, throatRadius, geodesicTolerance, k7, error);
+        threadSteps++;
+        if (error > 1.0f && h > GEODESIC_MIN_STEP) {
+            h = std::max(nextStepSize(h, error), GEODESIC_MIN_STEP); // rejected, retry smaller
+            continue;
+        }
+
+        vec3 nextPos = plane.position(next);
+        int nextUniverse = next.l >= 0.0f ? 1 : 2;
+
+        // check the chord of this step for intersections, unless it crosses the throat
+        if (nextUniverse == universe) {
+            vec3 chord = nextPos - pos;
+            float chordLength = length(chord);
+            if (chordLength > 0.0f) {
+                vec3 chordDir = chord / chordLength;
+                HitInfo hit = intersectScene(pos, chordDir, universe, chordLength);
+                if (hit.hit) {
+                    return shadeHit(hit, pos, chordDir, universe);
+                }
+            }
+        }
+
+        geoRay = next;
+        k1 = k7;
+        pos = nextPos;
+        universe = nextUniverse;
+        dir = plane.direction(geoRay);
+
+        // large steps in weak curvature, small ones near the throat
+        float r = plane.radius(geoRay);
+        h = std::min(nextStepSize(h, error), GEODESIC_MAX_STEP_FRACTION * r);
+
+        // escape condition
+        if (r > flatRadius && geoRay.l * geoRay.p > 0.0f) {
+            break; // moving away from the throat in flat enough space
+        }
+    }
+
+    // the rest of the path is a straight line
+    return traceStraight(pos, dir, universe);
+}
+
+// SIMD_WIDTH lanes, each integrating its own ray with its own step size. the
+// dormand-prince step runs on all lanes at once, while the per-lane rest (step size
+// control, chords, termination) stays scalar. a lane whose ray is done is refilled
+// with the next ray, so one ray winding around the throat doesn't idle the others
+struct RayPacket {
+    alignas(32) float l[SIMD_WIDTH], phi[SIMD_WIDTH], p[SIMD_WIDTH];
+    alignas(32) float k1l[SIMD_WIDTH], k1phi[SIMD_WIDTH], k1p[SIMD_WIDTH];
+    alignas(32) float L[SIMD_WIDTH], h[SIMD_WIDTH];
+    GeodesicPlane planes[SIMD_WIDTH];
+    vec3 positions[SIMD_WIDTH];
+    int universes[SIMD_WIDTH];
+    int rays[SIMD_WIDTH];
+    int steps[SIMD_WIDTH];
+
+    void set(int lane, const GeodesicRay& state, const GeodesicRay& k1) {
+        l[lane] = state.l;
+        phi[lane] = state.phi;
+        p[lane] = state.p;
+        k1l[lane] = k1.l;
+        k1phi[lane] = k1.phi;
+        k1p[lane] = k1.p;
+    }
+
+    GeodesicRay state(int lane) const {
+        return {l[lane], phi[lane], p[lane]};
+    }
+
+    // an empty lane keeps integrating harmless numbers, there are no masked loads
+    void park(int lane) {
+        set(lane, {throatRadius, 0.0f, 1.0f}, {1.0f, 0.0f, 0.0f});
+        L[lane] = 0.0f;
+        h[lane] = GEODESIC_INITIAL_STEP;
+    }
+};
+
+// traces count rays from origin, same result as traceRay on each
+void traceRayPacket(const vec3& origin, const vec3* directions, vec3* colors, int count) {
+    RayPacket packet;
+    float flatRadius = flatSpaceFactor * throatRadius;
+    int queued = 0;
+
+    auto fill = [&](int lane) {
+        while (queued < count) {
+            int ray = queued++;
+            vec3 pos;
+            if (traceFlatApproach(origin, directions[ray], 1, pos, colors[ray])) {
+                continue;
             }
-            // simple lambertian lighting
-            vec3 sunPos = (geoRay.universe == 1) ? spheres[0].center : spheres[3].center;
-            vec3 lightDir = normalize(sunPos - (geoRay.pos + normalize(geoRay.momentum) * hit.distance));
-            float diffuse = std::max(0.0f, dot(hit.normal, lightDir));
-            return hit.color * (0.2f + 0.8f * diffuse);
+            GeodesicPlane& plane = packet.planes[lane];
+            plane = GeodesicPlane(pos, directions[ray], THROAT_CENTER, throatRadius, 1);
+            packet.set(lane, plane.start, geodesicDerivatives(plane.start, plane.L, throatRadius));
+            packet.L[lane] = plane.L;
+            packet.h[lane] = GEODESIC_INITIAL_STEP;
+            packet.positions[lane] = pos;
+            packet.universes[lane] = 1;
+            packet.rays[lane] = ray;
+            packet.steps[lane] = 0;
+            return true;
         }
+        packet.park(lane);
+        return false;
+    };
 
-        // RK4 integration step
-        GeodesicRay k1 = derivatives(geoRay);
-        
-        GeodesicRay temp;
-        temp.pos = geoRay.pos + k1.pos * (step_size / 2.0f);
-        temp.momentum = geoRay.momentum + k1.momentum * (step_size / 2.0f);
-        GeodesicRay k2 = derivatives(temp);
+    unsigned active = 0; // lane mask of rays still integrating
+    for (int lane = 0; lane < SIMD_WIDTH; ++lane) {
+        if (fill(lane)) {
+            active |= 1u << lane;
+        }
+    }
 
-        temp.pos = geoRay.pos + k2.pos * (step_size / 2.0f);
-        temp.momentum = geoRay.momentum + k2.momentum * (step_size / 2.0f);
-        GeodesicRay k3 = derivatives(temp);
+    while (active) {
+        GeodesicState<FloatN> state = {FloatN::load(packet.l), FloatN::load(packet.phi), FloatN::load(packet.p)};
+        GeodesicState<FloatN> k1 = {FloatN::load(packet.k1l), FloatN::load(packet.k1phi), FloatN::load(packet.k1p)};
+        GeodesicState<FloatN> k7;
+        FloatN error;
+        GeodesicState<FloatN> next = dormandPrinceStep(state, k1, FloatN::load(packet.L), FloatN::load(packet.h),
+                                                       throatRadius, geodesicTolerance, k7, error);
+        alignas(32) float nl[SIMD_WIDTH], nphi[SIMD_WIDTH], np[SIMD_WIDTH];
+        alignas(32) float kl[SIMD_WIDTH], kphi[SIMD_WIDTH], kp[SIMD_WIDTH], errors[SIMD_WIDTH];
+        next.l.store(nl);
+        next.phi.store(nphi);
+        next.p.store(np);
+        k7.l.store(kl);
+        k7.phi.store(kphi);
+        k7.p.store(kp);
+        error.store(errors);
 
-        temp.pos = geoRay.pos + k3.pos * step_size;
-        temp.momentum = geoRay.momentum + k3.momentum * step_size;
-        GeodesicRay k4 = derivatives(temp);
+        for (int lane = 0; lane < SIMD_WIDTH; ++lane) {
+            if (!(active & (1u << lane))) {
+                continue;
+            }
+            const GeodesicPlane& plane = packet.planes[lane];
+            vec3& pos = packet.positions[lane];
+            int& universe = packet.universes[lane];
+            vec3& color = colors[packet.rays[lane]];
+            float& h = packet.h[lane];
+            bool finished = false;
+            threadSteps++;
 
-        geoRay.pos += (k1.pos + 2.0f * k2.pos + 2.0f * k3.pos + k4.pos) * (step_size / 6.0f);
-        geoRay.momentum += (k1.momentum + 2.0f * k2.momentum + 2.0f * k3.momentum + k4.momentum) * (step_size / 6.0f);
+            if (errors[lane] > 1.0f && h > GEODESIC_MIN_STEP) {
+                h = std::max(nextStepSize(h, errors[lane]), GEODESIC_MIN_STEP); // rejected, retry smaller
+            } else {
+                GeodesicRay nextRay = {nl[lane], nphi[lane], np[lane]};
+                vec3 nextPos = plane.position(nextRay);
+                int nextUniverse = nextRay.l >= 0.0f ? 1 : 2;
+                if (nextUniverse == universe) {
+                    vec3 chord = nextPos - pos;
+                    float chordLength = length(chord);
+                    if (chordLength > 0.0f) {
+                        vec3 chordDir = chord / chordLength;
+                        HitInfo hit = intersectScene(pos, chordDir, universe, chordLength);
+                        if (hit.hit) {
+                            color = shadeHit(hit, pos, chordDir, universe);
+                            finished = true;
+                        }
+                    }
+                }
+                if (!finished) {
+                    packet.set(lane, nextRay, {kl[lane], kphi[lane], kp[lane]});
+                    pos = nextPos;
+                    universe = nextUniverse;
+                    float r = plane.radius(nextRay);
+                    h = std::min(nextStepSize(h, errors[lane]), GEODESIC_MAX_STEP_FRACTION * r);
+                    if (r > flatRadius && nextRay.l * nextRay.p > 0.0f) {
+                        color = traceStraight(pos, plane.direction(nextRay), universe);
+                        finished = true;
+                    }
+                }
+            }
 
-        // check for wormhole traversal
-        float dist_from_center_sq = dot(geoRay.pos, geoRay.pos);
-        if (dist_from_center_sq < THROAT_RADIUS * THROAT_RADIUS) {
-            geoRay.pos = -geoRay.pos; // teleport to the other side
-            geoRay.universe = (geoRay.universe == 1) ? 2 : 1;
+            if (!finished && ++packet.steps[lane] >= GEODESIC_MAX_STEPS) {
+                color = traceStraight(pos, plane.direction(packet.state(lane)), universe);
+                finished = true;
+            }
+            if (finished && !fill(lane)) {
+                active &= ~(1u << lane);
+            }
         }
+    }
+}
 
-        // escape condition
-        if (dist_from_center_sq > 20000.0f * 20000.0f) {
-            break; // ray has flown off to infinity
+// every ray starting at the same distance R from the throat, at the same angle alpha
+// to the outward radial, follows the same path in its own plane; only the plane's
+// orientation differs. a fan integrates a few thousand angles at one R once, and the
+// rays of a frame, and of every following frame from the same radius, just replay the
+// path of the nearest angle in their own plane. the nearest angle is off by less than
+// half a fan spacing, a small fraction of a pixel at the default size
+struct GeodesicFan {
+    float R = 0.0f;
+    vector<float> L;
+    vector<vector<vec3>> paths; // accepted states as (e1, e2) plane coordinates and l, starting with the initial one
+    vector<vector<vec2>> ranges; // distances to the throat covered by the chord ending at each state
+    vector<GeodesicRay> exits;  // last state, the rest of the ray is straight
+
+    int index(float alpha) const {
+        int count = (int)paths.size();
+        return glm::clamp((int)std::lround(alpha / (float)M_PI * (count - 1)), 0, count - 1);
+    }
+
+    // same steps as traceRay, recorded instead of tested against the scene
+    void build(float radius, int count) {
+        R = radius;
+        L.assign(count, 0.0f);
+        paths.assign(count, {});
+        ranges.assign(count, {});
+        exits.assign(count, {});
+        float flatRadius = flatSpaceFactor * throatRadius;
+        #pragma omp parallel for schedule(dynamic)
+        for (int i = 0; i < count; ++i) {
+            float alpha = (float)M_PI * (float)i / (float)(count - 1);
+            float angularMomentum = R * std::sin(alpha);
+            GeodesicRay ray = {std::sqrt(R * R - throatRadius * throatRadius), 0.0f, std::cos(alpha)};
+            vector<vec3>& path = paths[i];
+            auto record = [&](const GeodesicRay& state) {
+                float radial = (state.l >= 0.0f ? 1.0f : -1.0f) * std::sqrt(state.l * state.l + throatRadius * throatRadius);
+                path.push_back(vec3(radial * std::cos(state.phi), radial * std::sin(state.phi), state.l));
+                vec2 a = path.size() > 1 ? vec2(path[path.size() - 2]) : vec2(path.back());
+                vec2 b = vec2(path.back());
+                vec2 chord = b - a;
+                float t = dot(chord, chord) > 0.0f ? glm::clamp(-dot(a, chord) / dot(chord, chord), 0.0f, 1.0f) : 0.0f;
+                ranges[i].push_back(vec2(length(a + chord * t), std::max(length(a), length(b))));
+            };
+            record(ray);
+
+            float h = GEODESIC_INITIAL_STEP;
+            GeodesicRay k1 = geodesicDerivatives(ray, angularMomentum, throatRadius);
+            uint64_t steps = 0; // accepted or not, like traceRay counts them
+            for (int step = 0; step < GEODESIC_MAX_STEPS; ++step) {
+                GeodesicRay k7;
+                float error;
+                GeodesicRay next = dormandPrinceStep(ray, k1, angularMomentum, h, throatRadius, geodesicTolerance, k7, error);
+                steps++;
+                if (error > 1.0f && h > GEODESIC_MIN_STEP) {
+                    h = std::max(nextStepSize(h, error), GEODESIC_MIN_STEP);
+                    continue;
+                }
+                ray = next;
+                k1 = k7;
+                record(ray);
+                float r = std::sqrt(ray.l * ray.l + throatRadius * throatRadius);
+                h = std::min(nextStepSize(h, error), GEODESIC_MAX_STEP_FRACTION * r);
+                if (r > flatRadius && ray.l * ray.p > 0.0f) {
+                    break;
+                }
+            }
+            L[i] = angularMomentum;
+            exits[i] = ray;
+            integrationSteps += steps;
         }
     }
+};
 
-    // if we didn't hit anything, return a background color
-    return vec3(0.0, 0.0, 0.0); // pitch black space
+GeodesicFan fan;
+bool useFan = false; // path mode replays the fan instead of integrating every ray
+
+// traceRay for a camera at the fan's radius, replaying the fan's nearest path
+vec3 traceRayFan(const vec3& origin, const vec3& direction) {
+    vec3 pos;
+    vec3 color;
+    if (traceFlatApproach(origin, direction, 1, pos, color)) {
+        return color;
+    }
+
+    GeodesicPlane plane(pos, direction, THROAT_CENTER, throatRadius, 1);
+    int i = fan.index(std::acos(glm::clamp(plane.start.p, -1.0f, 1.0f)));
+    plane.L = fan.L[i];
+    const vector<vec3>& path = fan.paths[i];
+
+    int universe = 1;
+    for (size_t k = 1; k < path.size(); ++k) {
+        vec3 nextPos = THROAT_CENTER + path[k].x * plane.e1 + path[k].y * plane.e2;
+        int nextUniverse = path[k].z >= 0.0f ? 1 : 2;
+        const vec2& range = fan.ranges[i][k];
+        bool reachesSphere = false;
+        for (const auto& sphere : spheres) {
+            reachesSphere |= sphere.universeID == universe && sphere.shellOuter >= range.x && sphere.shellInner <= range.y;
+        }
+        if (nextUniverse == universe && reachesSphere) {
+            vec3 chord = nextPos - pos;
+            float chordLength = length(chord);
+            if (chordLength > 0.0f) {
+                vec3 chordDir = chord / chordLength;
+                HitInfo hit = intersectScene(pos, chordDir, universe, chordLength);
+                if (hit.hit) {
+                    return shadeHit(hit, pos, chordDir, universe);
+                }
+            }
+        }
+        pos = nextPos;
+        universe = nextUniverse;
+    }
+    return traceStraight(pos, plane.direction(fan.exits[i]), universe);
+}
+
+// radius the rays of a camera at origin start integrating from, see traceFlatApproach
+float fanRadius(const vec3& origin) {
+    float distance = std::min(length(origin - THROAT_CENTER), flatSpaceFactor * throatRadius);
+    return std::max(distance, throatRadius * 1.0001f);
+}
+
+// same picture from the deflection table: straight lines outside the lens sphere, and
+// a table lookup for where the ray leaves it. objects inside the lens sphere are only
+// seen along the straight parts, so it's meant for scenes that keep clear of the throat
+vec3 traceRayTable(const vec3& origin, const vec3& direction) {
+    float lensRadius = deflectionTable.maxRadius * throatRadius;
+    vec3 entry = origin;
+    vec3 offset = origin - THROAT_CENTER;
+    if (length(offset) > lensRadius) {
+        float b = dot(offset, direction);
+        float c = dot(offset, offset) - lensRadius * lensRadius;
+        float discriminant = b * b - c;
+        float t = -b - sqrt(std::max(discriminant, 0.0f));
+        HitInfo hit = intersectScene(origin, direction, 1, discriminant > 0.0f && t > 0.0f ? t : 1e10f);
+        if (hit.hit) {
+            return shadeHit(hit, origin, direction, 1);
+        }
+        if (discriminant <= 0.0f || t <= 0.0f) {
+            return vec3(0.0, 0.0, 0.0); // misses the lens sphere, nothing else to hit
+        }
+        entry = origin + direction * t;
+    }
+
+    GeodesicPlane plane(entry, direction, THROAT_CENTER, throatRadius, 1);
+    float R = std::max(length(entry - THROAT_CENTER), throatRadius) / throatRadius;
+    float alpha = acos(glm::clamp(plane.start.p, -1.0f, 1.0f));
+    vec4 exit = deflectionTable.sample(R, alpha);
+    if (exit.w < 0.5f) {
+        return vec3(0.0, 0.0, 0.0); // trapped at the throat
+    }
+
+    int universe = exit.y > 0.5f ? 2 : 1;
+    GeodesicRay exitRay = plane.exitState(lensRadius, exit.x, universe == 1 ? 1.0f : -1.0f);
+    vec3 pos = plane.position(exitRay);
+    vec3 dir = plane.direction(exitRay);
+    return traceStraight(pos, dir, universe);
 }
 
 
 //------------------------------------------------------------------------------
-// main
+// tile scheduler
 //------------------------------------------------------------------------------
-int main(int argc, char** argv) {
-    cout << "\nwormhole geodesic renderer (physically accurate)\n";
-    cout << "this will be very slow. rendering one frame...\n";
+struct Tile {
+    int x0, y0, x1, y1;
+};
 
-    // scene setup
-    spheres.push_back({vec3(0, 5000, -6000), 1000, vec3(1.0f, 0.9f, 0.7f), true, 1});
-    spheres.push_back({vec3(-80, 40, 0), 10, vec3(1.0f, 0.2f, 0.2f), false, 1});
-    spheres.push_back({vec3(-120, 0, 0), 12, vec3(1.0f, 0.5f, 0.0f), false, 1});
-    
-    spheres.push_back({vec3(0, -7000, 8000), 1500, vec3(0.7f, 0.8f, 1.0f), true, 2});
-    spheres.push_back({vec3(80, 40, 0), 18, vec3(1.0f, 1.0f, 0.2f), false, 2});
-    spheres.push_back({vec3(120, 0, 0), 22, vec3(1.0f, 1.0f, 1.0f), false, 2});
+// ray cost varies by orders of magnitude between sky and throat pixels, so the image
+// is cut into small tiles. every worker owns a queue and takes tiles from its front,
+// and a worker that runs dry steals from the back of another one. tiles are dealt out
+// center first, so the middle of the image, where the throat usually is, comes first
+struct TileScheduler {
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Tile> tiles;
+    };
+    vector<unique_ptr<Queue>> queues;
+    std::atomic<int> completed{0};
+    int total = 0;
 
-    // camera setup
-    Camera camera;
-    camera.position = vec3(0, 0, 80);
-    camera.target = vec3(0, 0, 0);
-    camera.up = vec3(0, 1, 0);
-    camera.fov = 60.0f;
+    TileScheduler(const Tile& region, int workers) {
+        vector<Tile> tiles;
+        for (int y = region.y0; y < region.y1; y += TILE_SIZE) {
+            for (int x = region.x0; x < region.x1; x += TILE_SIZE) {
+                tiles.push_back({x, y, std::min(x + TILE_SIZE, region.x1), std::min(y + TILE_SIZE, region.y1)});
+            }
+        }
+        vec2 center = vec2(region.x0 + region.x1, region.y0 + region.y1) * 0.5f;
+        auto centerDistance = [&](const Tile& t) {
+            return length(vec2(t.x0 + t.x1, t.y0 + t.y1) * 0.5f - center);
+        };
+        std::stable_sort(tiles.begin(), tiles.end(),
+                         [&](const Tile& a, const Tile& b) { return centerDistance(a) < centerDistance(b); });
 
-    vector<unsigned char> pixels(WIDTH * HEIGHT * 3);
-    
-    auto t_start = chrono::high_resolution_clock::now();
+        for (int i = 0; i < workers; ++i) {
+            queues.push_back(make_unique<Queue>());
+        }
+        for (size_t i = 0; i < tiles.size(); ++i) {
+            queues[i % workers]->tiles.push_back(tiles[i]);
+        }
+        total = (int)tiles.size();
+    }
 
-    #pragma omp parallel for schedule(dynamic)
-    for (int y = 0; y < HEIGHT; ++y) {
-        if (omp_get_thread_num() == 0) {
-            cout << "rendering scanline " << y << "/" << HEIGHT << "\r" << flush;
+    // no tiles are added while rendering, so once every queue is empty the frame is done
+    bool next(int worker, Tile& tile) {
+        int count = (int)queues.size();
+        for (int i = 0; i < count; ++i) {
+            Queue& queue = *queues[(worker + i) % count];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (!queue.tiles.empty()) {
+                if (i == 0) {
+                    tile = queue.tiles.front();
+                    queue.tiles.pop_front();
+                } else {
+                    tile = queue.tiles.back();
+                    queue.tiles.pop_back();
+                }
+                return true;
+            }
         }
-        for (int x = 0; x < WIDTH; ++x) {
-            vec3 final_color(0.0f);
+        return false;
+    }
+};
 
-            // supersampling for antialiasing
-            for (int s = 0; s < SAMPLES_PER_PIXEL; ++s) {
-                float u = (float(x) + (float(s % 2) + 0.5f) / 2.0f) / float(WIDTH);
-                float v = (float(y) + (float(s / 2) + 0.5f) / 2.0f) / float(HEIGHT);
+// dark blue through cyan, green and yellow to red, same stops as in scene.glsl
+vec3 heatmapColor(float t) {
+    static const vec3 stops[5] = {vec3(0.0f, 0.0f, 0.4f), vec3(0.0f, 0.7f, 1.0f), vec3(0.1f, 0.9f, 0.2f),
+                                  vec3(1.0f, 0.9f, 0.0f), vec3(1.0f, 0.1f, 0.0f)};
+    float x = glm::clamp(t, 0.0f, 1.0f) * 4.0f;
+    int i = std::min((int)x, 3);
+    return mix(stops[i], stops[i + 1], x - (float)i);
+}
 
-                vec3 forward = normalize(camera.target - camera.position);
-                vec3 right = normalize(cross(forward, camera.up));
-                vec3 up = cross(right, forward);
+int pixelBytes() { return halfPixels ? 4 * (int)sizeof(uint16_t) : 3; }
 
-                float aspect = (float)WIDTH / (float)HEIGHT;
-                float tanHalfFov = tan(radians(camera.fov) * 0.5f);
-                
-                float Px = (2.0f * u - 1.0f) * aspect * tanHalfFov;
-                float Py = (1.0f - 2.0f * v) * tanHalfFov;
+// pixels holds the image of region, which tile is part of, pixelBytes() per pixel
+void renderTile(const Tile& tile, const Tile& region, const Camera& camera, const CameraBasis& basis, int width,
+                int height, vector<unsigned char>& pixels) {
+    // every sample of the tile, traced in packets when integrating
+    vector<vec3> directions;
+    for (int y = tile.y0; y < tile.y1; ++y) {
+        for (int x = tile.x0; x < tile.x1; ++x) {
+            // supersampling for antialiasing
+            for (int s = 0; s < SAMPLES_PER_PIXEL; ++s) {
+                float u = (float(x) + (float(s % 2) + 0.5f) / 2.0f) / float(width);
+                float v = (float(y) + (float(s / 2) + 0.5f) / 2.0f) / float(height);
+                directions.push_back(basis.rayDirection(u, v));
+            }
+        }
+    }
+    vector<vec3> colors(directions.size());
+    if (debugView != DEBUG_VIEW_NONE) {
+        // one ray at a time, so the counters can be told apart per sample
+        for (size_t i = 0; i < directions.size(); ++i) {
+            const vec3& d = directions[i];
+            uint64_t steps = threadSteps, primitives = threadPrimitives;
+            if (useTable) {
+                traceRayTable(camera.position, d);
+            } else if (useFan) {
+                traceRayFan(camera.position, d);
+            } else {
+                traceRay(camera.position, d);
+            }
+            float cost = (float)(debugView == DEBUG_VIEW_STEPS ? threadSteps - steps : threadPrimitives - primitives);
+            colors[i] = heatmapColor(std::log2(1.0f + cost) / std::log2(1.0f + HEATMAP_MAX_COST));
+        }
+    } else if (!useTable && !useFan && usePackets) {
+        traceRayPacket(camera.position, directions.data(), colors.data(), (int)directions.size());
+    } else {
+        for (size_t i = 0; i < directions.size(); ++i) {
+            const vec3& d = directions[i];
+            colors[i] = useTable ? traceRayTable(camera.position, d)
+                                 : useFan ? traceRayFan(camera.position, d) : traceRay(camera.position, d);
+        }
+    }
 
-                vec3 rayDir = normalize(Px * right + Py * up + forward);
-                final_color += traceRay(camera.position, rayDir);
+    size_t sample = 0;
+    for (int y = tile.y0; y < tile.y1; ++y) {
+        for (int x = tile.x0; x < tile.x1; ++x) {
+            vec3 final_color(0.0f);
+            for (int s = 0; s < SAMPLES_PER_PIXEL; ++s) {
+                final_color += colors[sample++];
             }
             final_color /= (float)SAMPLES_PER_PIXEL;
-            
-            int index = (y * WIDTH + x) * 3;
+
+            size_t index = ((size_t)(y - region.y0) * (region.x1 - region.x0) + (x - region.x0)) * pixelBytes();
+            if (halfPixels) {
+                uint16_t half[4] = {floatToHalf(final_color.r), floatToHalf(final_color.g), floatToHalf(final_color.b),
+                                    floatToHalf(1.0f)};
+                memcpy(&pixels[index], half, sizeof(half));
+                continue;
+            }
             pixels[index + 0] = static_cast<unsigned char>(glm::clamp(final_color.r, 0.0f, 1.0f) * 255);
             pixels[index + 1] = static_cast<unsigned char>(glm::clamp(final_color.g, 0.0f, 1.0f) * 255);
             pixels[index + 2] = static_cast<unsigned char>(glm::clamp(final_color.b, 0.0f, 1.0f) * 255);
         }
     }
+}
+
+// renders the region of a width x height image on numThreads threads
+vector<unsigned char> renderRegion(const Camera& camera, int width, int height, const Tile& region, int numThreads,
+                                   bool showProgress) {
+    vector<unsigned char> pixels((size_t)(region.x1 - region.x0) * (region.y1 - region.y0) * pixelBytes());
+    CameraBasis basis(camera, width, height);
+    TileScheduler scheduler(region, numThreads);
+    vector<std::thread> workers;
+    for (int w = 0; w < numThreads; ++w) {
+        workers.emplace_back([&, w]() {
+            Tile tile;
+            while (scheduler.next(w, tile)) {
+                renderTile(tile, region, camera, basis, width, height, pixels);
+                scheduler.completed.fetch_add(1, std::memory_order_relaxed);
+            }
+            integrationSteps += threadSteps;
+            primitivesTested += threadPrimitives;
+            threadSteps = 0;
+            threadPrimitives = 0;
+        });
+    }
+    while (showProgress && scheduler.completed.load() < scheduler.total) {
+        cout << "rendering tile " << scheduler.completed.load() << "/" << scheduler.total << "\r" << flush;
+        std::this_thread::sleep_for(chrono::milliseconds(100));
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    return pixels;
+}
+
+void loadDeflectionTable() {
+    auto t_table = chrono::high_resolution_clock::now();
+    bool cached = deflectionTable.loadOrBuild("deflection_lut_geodesic.bin", LENS_RADIUS, geodesicTolerance);
+    double table_s = chrono::duration<double>(chrono::high_resolution_clock::now() - t_table).count();
+    cout << (cached ? "loaded" : "integrated") << " deflection table in " << fixed << setprecision(2) << table_s << " seconds.\n";
+}
+
+// a png of the rgb8 image, or with --hdr the half image handed to hdr, which writes
+// it in the background
+bool saveImage(const string& filename, int index, int width, int height, const vector<unsigned char>& pixels,
+               HdrFrameWriter* hdr) {
+    if (!hdr) {
+        return stbi_write_png(filename.c_str(), width, height, 3, pixels.data(), width * 3) != 0;
+    }
+    vector<uint16_t> half = hdr->acquireBuffer();
+    half.resize(pixels.size() / sizeof(uint16_t));
+    memcpy(half.data(), pixels.data(), pixels.size());
+    hdr->submit(index, std::move(half));
+    return true;
+}
+
+void setupScene(const Scene& scene) {
+    throatRadius = scene.throatRadius;
+    sunIndex[0] = scene.sunIndex[0];
+    sunIndex[1] = scene.sunIndex[1];
+    spheres.clear();
+    for (const SceneSphere& s : scene.spheres) {
+        const float* c = s.centerAndRadius;
+        spheres.push_back({vec3(c[0], c[1], c[2]), c[3], vec3(s.color[0], s.color[1], s.color[2]), s.properties[0] > 0.5f,
+                           (int)s.properties[1]});
+    }
+    updateSphereShells();
+}
+
+
+//------------------------------------------------------------------------------
+// distributed rendering
+//------------------------------------------------------------------------------
+// the coordinator cuts every frame of camera_path.txt into JOB_TILE_SIZE tiles and
+// hands them to workers over tcp, one job per worker at a time. a worker that fails
+// or goes silent has its job put back in the queue, and once the queue is empty, idle
+// workers also take on jobs that run much longer than average, so one slow machine
+// can't hold up the end of the sequence. whichever copy finishes first wins.
+// messages are raw structs, so the farm has to share one byte order
+const uint32_t PROTOCOL_MAGIC = 0x574F524D; // "WORM"
+
+enum MessageType : uint32_t {
+    MESSAGE_HELLO = 1, // worker -> coordinator, HelloMessage
+    MESSAGE_JOB,       // coordinator -> worker, JobMessage
+    MESSAGE_RESULT,    // worker -> coordinator, job id and the tile's pixels, rgb8 or rgba halfs
+    MESSAGE_DONE,      // coordinator -> worker, nothing left to render
+};
+
+struct MessageHeader {
+    uint32_t magic;
+    uint32_t type;
+    uint32_t size; // bytes following the header
+};
+
+struct HelloMessage {
+    int32_t threads;
+};
+
+struct JobMessage {
+    int32_t id;
+    int32_t width, height;
+    Tile region;
+    float position[3], target[3], up[3], fov;
+    float tolerance, flatSpaceFactor;
+    int32_t useTable;
+    int32_t halfPixels;
+};
+
+bool sendMessage(const Socket& socket, MessageType type, const void* payload, size_t size,
+                 const void* extra = nullptr, size_t extraSize = 0) {
+    MessageHeader header = {PROTOCOL_MAGIC, type, (uint32_t)(size + extraSize)};
+    return socket.sendAll(&header, sizeof(header)) && (size == 0 || socket.sendAll(payload, size)) &&
+           (extraSize == 0 || socket.sendAll(extra, extraSize));
+}
+
+bool receiveHeader(const Socket& socket, MessageHeader& header) {
+    return socket.recvAll(&header, sizeof(header)) && header.magic == PROTOCOL_MAGIC;
+}
+
+struct Coordinator {
+    struct Job {
+        JobMessage message;
+        int frame;
+        int running = 0; // workers currently on it
+        bool done = false;
+        chrono::steady_clock::time_point started; // when the first of its current workers took it
+    };
+    struct Frame {
+        vector<unsigned char> pixels;
+        int remaining = 0; // jobs still missing
+    };
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    vector<Job> jobs;
+    std::deque<int> pending;
+    vector<Frame> frames;
+    int width, height;
+    int completed = 0;
+    double jobSeconds = 0.0; // summed over the completed jobs, for the straggler threshold
+    string exportDir;
+    HdrFrameWriter* hdr = nullptr; // pngs when null
+
+    // every worker that ever connected and the thread serving it, all kept until shutdown
+    vector<Socket> connections;
+    vector<bool> serving; // its thread is still running
+    vector<std::thread> servers;
+    bool finished = false;
+
+    // blocks until there is a job for this worker, false once everything is done
+    bool take(int& id) {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (completed < (int)jobs.size()) {
+            if (!pending.empty()) {
+                id = pending.front();
+                pending.pop_front();
+            } else if (!straggler(id)) {
+                changed.wait_for(lock, chrono::seconds(1));
+                continue;
+            }
+            // a straggler copy keeps the original start, which the average and the
+            // straggler threshold are measured from
+            if (jobs[id].running++ == 0) {
+                jobs[id].started = chrono::steady_clock::now();
+            }
+            return true;
+        }
+        return false;
+    }
+
+    // the longest running job that is far beyond the average and has a single worker
+    bool straggler(int& id) {
+        if (completed == 0) {
+            return false;
+        }
+        double threshold = STRAGGLER_FACTOR * jobSeconds / completed;
+        auto now = chrono::steady_clock::now();
+        double longest = threshold;
+        bool found = false;
+        for (size_t i = 0; i < jobs.size(); ++i) {
+            double seconds = chrono::duration<double>(now - jobs[i].started).count();
+            if (!jobs[i].done && jobs[i].running == 1 && seconds > longest) {
+                longest = seconds;
+                id = (int)i;
+                found = true;
+            }
+        }
+        return found;
+    }
+
+    // false when the worker was only cut off by shutdown
+    bool fail(int id) {
+        std::lock_guard<std::mutex> lock(mutex);
+        Job& job = jobs[id];
+        if (--job.running == 0 && !job.done) {
+            pending.push_front(id);
+        }
+        changed.notify_all();
+        return !finished;
+    }
+
+    void complete(int id, const vector<unsigned char>& tile) {
+        vector<unsigned char> finished;
+        int frameIndex;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            Job& job = jobs[id];
+            job.running--;
+            if (job.done) {
+                return; // a straggler copy that lost
+            }
+            job.done = true;
+            completed++;
+            jobSeconds += chrono::duration<double>(chrono::steady_clock::now() - job.started).count();
+            changed.notify_all();
+
+            frameIndex = job.frame;
+            Frame& frame = frames[frameIndex];
+            if (frame.pixels.empty()) {
+                frame.pixels.resize((size_t)width * height * pixelBytes());
+            }
+            const Tile& r = job.message.region;
+            size_t rowBytes = (size_t)(r.x1 - r.x0) * pixelBytes();
+            for (int y = r.y0; y < r.y1; ++y) {
+                memcpy(&frame.pixels[((size_t)y * width + r.x0) * pixelBytes()], &tile[(y - r.y0) * rowBytes], rowBytes);
+            }
+            if (--frame.remaining > 0) {
+                return;
+            }
+            finished.swap(frame.pixels);
+        }
+
+        char name[64];
+        snprintf(name, sizeof(name), "/frame_%05d.png", frameIndex);
+        string filename = exportDir + name;
+        if (!saveImage(filename, frameIndex, width, height, finished, hdr)) {
+            cerr << "error: failed to save image to " << filename << "\n";
+        }
+    }
+
+    // called by the acceptor for every new worker
+    void connect(Socket socket) {
+        std::lock_guard<std::mutex> lock(mutex);
+        connections.push_back(socket);
+        serving.push_back(true);
+        servers.emplace_back(&Coordinator::serve, this, connections.size() - 1);
+    }
+
+    // one thread per connected worker. the socket is closed by shutdown, once the
+    // thread is gone
+    void serve(size_t index) {
+        Socket socket;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            socket = connections[index];
+        }
+        serveWorker(socket);
+        std::lock_guard<std::mutex> lock(mutex);
+        serving[index] = false;
+    }
+
+    void serveWorker(Socket socket) {
+        MessageHeader header;
+        HelloMessage hello;
+        if (!receiveHeader(socket, header) || header.type != MESSAGE_HELLO || header.size != sizeof(hello) ||
+            !socket.recvAll(&hello, sizeof(hello))) {
+            return;
+        }
+        cout << "worker connected (" << hello.threads << " threads)\n";
+        socket.setTimeout(WORKER_TIMEOUT_SECONDS);
+
+        int id;
+        vector<unsigned char> tile;
+        while (take(id)) {
+            const JobMessage& job = jobs[id].message;
+            size_t tileBytes = (size_t)(job.region.x1 - job.region.x0) * (job.region.y1 - job.region.y0) * pixelBytes();
+            int32_t resultId = -1;
+            tile.resize(tileBytes);
+            bool ok = sendMessage(socket, MESSAGE_JOB, &job, sizeof(job)) && receiveHeader(socket, header) &&
+                      header.type == MESSAGE_RESULT && header.size == sizeof(resultId) + tileBytes &&
+                      socket.recvAll(&resultId, sizeof(resultId)) && resultId == id &&
+                      socket.recvAll(tile.data(), tileBytes);
+            if (!ok) {
+                if (fail(id)) {
+                    cout << "worker lost, job " << id << " goes back in the queue\n";
+                }
+                return;
+            }
+            complete(id, tile);
+        }
+        sendMessage(socket, MESSAGE_DONE, nullptr, 0);
+    }
+
+    // after the last job, with the acceptor stopped: the threads still waiting for a
+    // straggler copy that lost are woken up, their workers told to stop, and all joined
+    void shutdown() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            finished = true;
+            for (size_t i = 0; i < connections.size(); ++i) {
+                if (serving[i]) {
+                    sendMessage(connections[i], MESSAGE_DONE, nullptr, 0);
+                    connections[i].shutdown();
+                }
+            }
+        }
+        for (auto& server : servers) {
+            server.join();
+        }
+        for (Socket& socket : connections) {
+            socket.close();
+        }
+    }
+};
+
+void runCoordinator(int port, int width, int height, HdrFormat hdrFormat) {
+    vector<Keyframe> keys;
+    if (!loadCameraPath("camera_path.txt", keys)) {
+        cout << "error: camera_path.txt not found or invalid.\n";
+        return;
+    }
+
+    Coordinator coordinator;
+    coordinator.width = width;
+    coordinator.height = height;
+    coordinator.exportDir = "exports/geodesic_path";
+    std::filesystem::create_directories(coordinator.exportDir);
+    HdrFrameWriter hdrWriter;
+    string hdrPath = hdrFormat == HDR_RAW ? coordinator.exportDir + ".hraw" : coordinator.exportDir;
+    if (hdrFormat != HDR_NONE) {
+        if (!hdrWriter.open(hdrFormat, hdrPath, width, height, PATH_FPS)) {
+            cerr << "error: could not create " << hdrPath << "\n";
+            return;
+        }
+        coordinator.hdr = &hdrWriter;
+    }
+
+    int totalFrames = std::max(1, (int)(keys.back().timeSec * PATH_FPS));
+    coordinator.frames.resize(totalFrames);
+    for (int f = 0; f < totalFrames; ++f) {
+        vec3 pos, target;
+        cameraPathAt(keys, (float)f / PATH_FPS, pos, target);
+        for (int y = 0; y < height; y += JOB_TILE_SIZE) {
+            for (int x = 0; x < width; x += JOB_TILE_SIZE) {
+                Coordinator::Job job;
+                job.frame = f;
+                JobMessage& m = job.message;
+                m.id = (int32_t)coordinator.jobs.size();
+                m.width = width;
+                m.height = height;
+                m.region = {x, y, std::min(x + JOB_TILE_SIZE, width), std::min(y + JOB_TILE_SIZE, height)};
+                memcpy(m.position, &pos[0], sizeof(m.position));
+                memcpy(m.target, &target[0], sizeof(m.target));
+                m.up[0] = 0.0f;
+                m.up[1] = 1.0f;
+                m.up[2] = 0.0f;
+                m.fov = 60.0f;
+                m.tolerance = geodesicTolerance;
+                m.flatSpaceFactor = flatSpaceFactor;
+                m.useTable = useTable ? 1 : 0;
+                m.halfPixels = halfPixels ? 1 : 0;
+                coordinator.pending.push_back(m.id);
+                coordinator.jobs.push_back(job);
+                coordinator.frames[f].remaining++;
+            }
+        }
+    }
+
+    Socket listener = Socket::listen(port);
+    if (!listener.valid()) {
+        cerr << "error: can't listen on port " << port << "\n";
+        return;
+    }
+    cout << "coordinating " << totalFrames << " frames (" << coordinator.jobs.size() << " jobs) on port " << port << "\n";
+
+    auto t_start = chrono::high_resolution_clock::now();
+    std::thread acceptor([&]() {
+        while (true) {
+            Socket socket = listener.accept();
+            if (!socket.valid()) {
+                return; // listener closed
+            }
+            coordinator.connect(socket);
+        }
+    });
+
+    {
+        std::unique_lock<std::mutex> lock(coordinator.mutex);
+        while (coordinator.completed < (int)coordinator.jobs.size()) {
+            cout << "rendered job " << coordinator.completed << "/" << coordinator.jobs.size() << "\r" << flush;
+            coordinator.changed.wait_for(lock, chrono::seconds(1));
+        }
+    }
+    listener.close();
+    acceptor.join();
+    coordinator.shutdown();
+
+    if (coordinator.hdr && !hdrWriter.close()) {
+        cerr << "error: failed to write " << hdrPath << "\n";
+    }
+    double elapsed_time_s = chrono::duration<double>(chrono::high_resolution_clock::now() - t_start).count();
+    cout << "\nsequence finished in " << fixed << setprecision(2) << elapsed_time_s << " seconds, frames saved to "
+         << (coordinator.hdr ? hdrPath : coordinator.exportDir) << "\n";
+}
+
+void runWorker(const string& host, int port, int numThreads) {
+    Socket socket;
+    for (int attempt = 0; attempt < WORKER_CONNECT_ATTEMPTS && !socket.valid(); ++attempt) {
+        socket = Socket::connect(host, port);
+        if (!socket.valid()) {
+            std::this_thread::sleep_for(chrono::seconds(1));
+        }
+    }
+    if (!socket.valid()) {
+        cerr << "error: can't reach the coordinator at " << host << ":" << port << "\n";
+        return;
+    }
+
+    HelloMessage hello = {numThreads};
+    if (!sendMessage(socket, MESSAGE_HELLO, &hello, sizeof(hello))) {
+        cerr << "error: lost the coordinator\n";
+        socket.close();
+        return;
+    }
+    cout << "connected to " << host << ":" << port << "\n";
+
+    int jobs = 0;
+    MessageHeader header = {};
+    JobMessage job;
+    while (receiveHeader(socket, header) && header.type == MESSAGE_JOB && header.size == sizeof(job) &&
+           socket.recvAll(&job, sizeof(job))) {
+        geodesicTolerance = job.tolerance;
+        flatSpaceFactor = job.flatSpaceFactor;
+        useTable = job.useTable != 0;
+        halfPixels = job.halfPixels != 0;
+        if (useTable && deflectionTable.texels.empty()) {
+            loadDeflectionTable();
+        }
+
+        Camera camera;
+        camera.position = vec3(job.position[0], job.position[1], job.position[2]);
+        camera.target = vec3(job.target[0], job.target[1], job.target[2]);
+        camera.up = vec3(job.up[0], job.up[1], job.up[2]);
+        camera.fov = job.fov;
+        vector<unsigned char> pixels = renderRegion(camera, job.width, job.height, job.region, numThreads, false);
+
+        int32_t id = job.id;
+        if (!sendMessage(socket, MESSAGE_RESULT, &id, sizeof(id), pixels.data(), pixels.size())) {
+            break;
+        }
+        cout << "rendered job " << ++jobs << "\r" << flush;
+    }
+    cout << "\n" << (header.type == MESSAGE_DONE ? "coordinator finished" : "lost the coordinator") << " after "
+         << jobs << " jobs\n";
+    socket.close();
+}
+
+
+// renders every frame of camera_path.txt on this machine. with --lut the deflection
+// table is built once for the whole sequence, otherwise a frame reuses the previous
+// frame's fan while the camera stays at the same distance from the throat
+void runPathMode(int width, int height, int numThreads, int fanRays, HdrFormat hdrFormat) {
+    vector<Keyframe> keys;
+    if (!loadCameraPath("camera_path.txt", keys)) {
+        cout << "error: camera_path.txt not found or invalid.\n";
+        return;
+    }
+    string exportDir = "exports/geodesic_path";
+    std::filesystem::create_directories(exportDir);
+    HdrFrameWriter hdrWriter;
+    if (hdrFormat != HDR_NONE) {
+        if (hdrFormat == HDR_RAW) {
+            exportDir += ".hraw";
+        }
+        if (!hdrWriter.open(hdrFormat, exportDir, width, height, PATH_FPS)) {
+            cerr << "error: could not create " << exportDir << "\n";
+            return;
+        }
+    }
+    if (useTable) {
+        loadDeflectionTable();
+    }
+    useFan = !useTable && fanRays > 1;
+
+    int totalFrames = std::max(1, (int)(keys.back().timeSec * PATH_FPS));
+    cout << "rendering " << totalFrames << " frames from camera_path.txt...\n";
+    auto t_start = chrono::high_resolution_clock::now();
+    int fansBuilt = 0;
+    for (int f = 0; f < totalFrames; ++f) {
+        Camera camera;
+        cameraPathAt(keys, (float)f / PATH_FPS, camera.position, camera.target);
+        camera.up = vec3(0, 1, 0);
+        camera.fov = 60.0f;
+
+        float R = fanRadius(camera.position);
+        if (useFan && (fan.paths.empty() || std::abs(R - fan.R) > FAN_RADIUS_TOLERANCE * fan.R)) {
+            fan.build(R, fanRays);
+            fansBuilt++;
+        }
+
+        vector<unsigned char> pixels = renderRegion(camera, width, height, {0, 0, width, height}, numThreads, false);
+        char name[64];
+        snprintf(name, sizeof(name), "/frame_%05d.png", f);
+        string filename = exportDir + name;
+        if (!saveImage(filename, f, width, height, pixels, hdrFormat != HDR_NONE ? &hdrWriter : nullptr)) {
+            cerr << "error: failed to save image to " << filename << "\n";
+        }
+        cout << "rendered frame " << (f + 1) << "/" << totalFrames << "\r" << flush;
+    }
+    if (hdrFormat != HDR_NONE && !hdrWriter.close()) {
+        cerr << "error: failed to write " << exportDir << "\n";
+    }
+    double elapsed_time_s = chrono::duration<double>(chrono::high_resolution_clock::now() - t_start).count();
+    cout << "\nsequence finished in " << fixed << setprecision(2) << elapsed_time_s << " seconds";
+    if (useFan) {
+        cout << ", " << fansBuilt << " fans integrated for " << totalFrames << " frames";
+    }
+    cout << ", frames saved to " << exportDir << "\n";
+}
+
+//------------------------------------------------------------------------------
+// benchmark
+//------------------------------------------------------------------------------
+// the planets and throat scenes of WormholeSim --bench, on the same camera paths from
+// bench.h. the current flags (--lut, --no-packets, --threads, ...) apply
+void runBench(const string& path, int width, int height, int numThreads, int frames) {
+    struct View {
+        const char* name;
+        vector<Keyframe> keys;
+    };
+    const View views[] = {
+        {"planets", benchOrbitPath()},
+        {"throat", benchThroatPath()},
+    };
+    string config = useTable ? "lut" : usePackets ? "packets" : "scalar";
+    if (useTable) {
+        loadDeflectionTable();
+    }
+
+    vector<BenchScene> results;
+    for (const View& view : views) {
+        BenchScene result;
+        result.name = view.name;
+        result.config = config;
+        result.raysPerFrame = (double)width * height * SAMPLES_PER_PIXEL;
+        for (int f = -BENCH_WARMUP_FRAMES; f < frames; ++f) {
+            Camera camera;
+            cameraPathAt(view.keys, frames > 1 ? (float)std::max(f, 0) / (float)(frames - 1) : 0.0f, camera.position, camera.target);
+            camera.up = vec3(0, 1, 0);
+            camera.fov = 60.0f;
+            if (f == 0) {
+                integrationSteps = 0;
+            }
+
+            auto t_start = chrono::high_resolution_clock::now();
+            renderRegion(camera, width, height, {0, 0, width, height}, numThreads, false);
+            double ms = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - t_start).count();
+            if (f >= 0) {
+                result.frameMs.push_back(ms);
+            }
+        }
+        result.steps = useTable ? -1.0 : (double)integrationSteps.load();
+        printBenchScene(result);
+        results.push_back(result);
+    }
+
+    vector<pair<string, string>> info = {
+        {"width", to_string(width)}, {"height", to_string(height)}, {"threads", to_string(numThreads)},
+        {"warmup_frames", to_string(BENCH_WARMUP_FRAMES)}};
+    stringstream tolerance;
+    tolerance << geodesicTolerance;
+    info.push_back({"tolerance", tolerance.str()});
+    if (writeBenchJson(path, "cpu_geodesic", info, results)) {
+        cout << "benchmark results saved to " << path << "\n";
+    } else {
+        cerr << "error: failed to write " << path << "\n";
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// main
+//------------------------------------------------------------------------------
+int main(int argc, char** argv) {
+    int width = DEFAULT_WIDTH;
+    int height = DEFAULT_HEIGHT;
+    int numThreads = std::max(1, (int)std::thread::hardware_concurrency());
+    int coordinatorPort = 0;
+    string workerAddress;
+    bool pathMode = false;
+    int fanRays = DEFAULT_FAN_RAYS;
+    string benchPath;
+    int benchFrames = DEFAULT_BENCH_FRAMES;
+    string scenePath = "scene.txt";
+    HdrFormat hdrFormat = HDR_NONE;
+    for (int i = 1; i < argc; ++i) {
+        string a = argv[i];
+        if (a == "--width" && i + 1 < argc) width = std::max(1, atoi(argv[++i]));
+        if (a == "--height" && i + 1 < argc) height = std::max(1, atoi(argv[++i]));
+        if (a == "--tolerance" && i + 1 < argc) geodesicTolerance = std::max(1e-8f, (float)atof(argv[++i]));
+        if (a == "--lut") useTable = true;
+        if (a == "--no-packets") usePackets = false;
+        if (a == "--threads" && i + 1 < argc) numThreads = std::max(1, atoi(argv[++i]));
+        if (a == "--flat-radius" && i + 1 < argc) flatSpaceFactor = std::max(1.0f, (float)atof(argv[++i]));
+        if (a == "--coordinator" && i + 1 < argc) coordinatorPort = atoi(argv[++i]);
+        if (a == "--worker" && i + 1 < argc) workerAddress = argv[++i];
+        if (a == "--path") pathMode = true;
+        if (a == "--fan" && i + 1 < argc) fanRays = std::max(0, atoi(argv[++i]));
+        if (a == "--bench" && i + 1 < argc) benchPath = argv[++i];
+        if (a == "--bench-frames" && i + 1 < argc) benchFrames = std::max(1, atoi(argv[++i]));
+        if (a == "--scene" && i + 1 < argc) scenePath = argv[++i];
+        if (a == "--hdr" && i + 1 < argc && !parseHdrFormat(argv[++i], hdrFormat)) {
+            cerr << "error: --hdr expects exr or raw\n";
+            return 1;
+        }
+        if (a == "--heatmap" && i + 1 < argc) {
+            string view = argv[++i];
+            debugView = view == "steps" ? DEBUG_VIEW_STEPS : view == "primitives" ? DEBUG_VIEW_PRIMITIVES : DEBUG_VIEW_NONE;
+            if (debugView == DEBUG_VIEW_NONE) {
+                cerr << "error: --heatmap expects steps or primitives\n";
+                return 1;
+            }
+        }
+    }
+    halfPixels = hdrFormat != HDR_NONE;
+
+    {
+        Scene scene; // the spheres are copied out, so the mapping can go
+        if (!loadScene(scenePath, scene)) {
+            return 1;
+        }
+        setupScene(scene);
+    }
+
+    if (coordinatorPort > 0 || !workerAddress.empty()) {
+        if (!Socket::initialize()) {
+            cerr << "error: failed to initialize sockets\n";
+            return 1;
+        }
+        if (coordinatorPort > 0) {
+            runCoordinator(coordinatorPort, width, height, hdrFormat);
+        } else {
+            size_t colon = workerAddress.rfind(':');
+            if (colon == string::npos) {
+                cerr << "error: --worker expects host:port\n";
+                return 1;
+            }
+            runWorker(workerAddress.substr(0, colon), atoi(workerAddress.c_str() + colon + 1), numThreads);
+        }
+        return 0;
+    }
+
+    if (pathMode) {
+        runPathMode(width, height, numThreads, fanRays, hdrFormat);
+        return 0;
+    }
+
+    if (!benchPath.empty()) {
+        runBench(benchPath, width, height, numThreads, benchFrames);
+        return 0;
+    }
+
+    cout << "\nwormhole geodesic renderer (physically accurate)\n";
+    cout << "this will be very slow. rendering one frame...\n";
+
+    // camera setup
+    Camera camera;
+    camera.position = vec3(0, 0, 80);
+    camera.target = vec3(0, 0, 0);
+    camera.up = vec3(0, 1, 0);
+    camera.fov = 60.0f;
+
+    if (useTable) {
+        loadDeflectionTable();
+    }
+
+    integrationSteps = 0;
+    primitivesTested = 0;
+    auto t_start = chrono::high_resolution_clock::now();
+    vector<unsigned char> pixels = renderRegion(camera, width, height, {0, 0, width, height}, numThreads, true);
 
     auto t_end = chrono::high_resolution_clock::now();
     double elapsed_time_s = chrono::duration<double>(t_end - t_start).count();
     cout << "\nrender finished in " << fixed << setprecision(2) << elapsed_time_s << " seconds.\n";
+    double samples = (double)width * height * SAMPLES_PER_PIXEL;
+    cout << integrationSteps.load() << " integration steps (" << integrationSteps.load() / samples << " per sample), "
+         << primitivesTested.load() << " sphere tests (" << primitivesTested.load() / samples << " per sample)\n";
 
     // save the final image
     std::filesystem::create_directories("exports");
-    string filename = "exports/wormhole_geodesic_render.png";
-    int success = stbi_write_png(filename.c_str(), WIDTH, HEIGHT, 3, pixels.data(), WIDTH * 3);
-    
+    string filename = debugView == DEBUG_VIEW_NONE ? "exports/wormhole_geodesic_render" : "exports/wormhole_geodesic_heatmap";
+    bool success;
+    if (hdrFormat == HDR_EXR) {
+        filename += ".exr";
+        success = writeExr(filename, width, height, (const uint16_t*)pixels.data());
+    } else if (hdrFormat == HDR_RAW) {
+        HdrFrameWriter hdrWriter; // a stream of one frame
+        filename += ".hraw";
+        success = hdrWriter.open(hdrFormat, filename, width, height, PATH_FPS) &&
+                  saveImage(filename, 0, width, height, pixels, &hdrWriter) && hdrWriter.close();
+    } else {
+        filename += ".png";
+        success = saveImage(filename, 0, width, height, pixels, nullptr);
+    }
+
     if (success) {
         cout << "image saved to " << filename << "\n";
     } else {
@@ -1,15 +1,19 @@
 #ifdef _WIN32
 #include <windows.h>
-#endif
 
 // Force dedicated GPU on laptops
 extern "C" {
   __declspec(dllexport) DWORD NvOptimusEnablement = 0x00000001;
   __declspec(dllexport) int AmdPowerXpressRequestHighPerformance = 1;
 }
+#endif
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
+#ifdef WORMHOLE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -23,10 +27,30 @@ extern "C" {
 #include <thread>
 #include <chrono>
 #include <iomanip>
+#include <cstring>
+#include <cstdio>
+#include <csignal>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <unordered_map>
+#include <cstdint>
+#include <atomic>
+#include <memory>
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "tiny_obj_loader.h"
+
 #define _USE_MATH_DEFINES
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
 #endif
+#include "geodesic.h"
+#include "camera_path.h"
+#include "bench.h"
+#include "triple_buffer.h"
+#include "scene.h"
+#include "frame_writer.h"
 
 using namespace glm;
 using namespace std;
@@ -34,15 +58,53 @@ using namespace std;
 //------------------------------------------------------------------------------
 // constants
 //------------------------------------------------------------------------------
-const int WIDTH = 800;
-const int HEIGHT = 600;
+const int DEFAULT_WIDTH = 800;  // override with --width / --height
+const int DEFAULT_HEIGHT = 600;
 const int MOVIE_FPS = 24;
+const int READBACK_RING_SIZE = 3; // frames in flight between dispatch and cpu readback
+const int ENCODER_QUEUE_SIZE = 8;  // frames buffered between the render thread and the encoder
+const int MAX_EGL_DEVICES = 16;    // gpus a multi-gpu movie can spread its frames over
+const int STARFIELD_CUBEMAP_SIZE = 1024; // per-face resolution of the baked sky
+const int STAR_CELL_GRID = 32;           // star bins per cube face edge in binned mode
+const float DEFAULT_TARGET_FPS = 60.0f;     // frame rate the render scale controller aims for
+const float RENDER_SCALE_MIN = 0.25f;       // lowest internal resolution it may pick
+const float RENDER_SCALE_INTERVAL = 0.25f;  // seconds between render scale adjustments
+const int ACCUM_MAX_SAMPLES = 1024;         // a still view stops refining after this many samples
+const double SIM_TIMESTEP = 1.0 / 120.0;   // seconds per tick of the interactive simulation thread
+const double SIM_MAX_LAG = 0.25;            // ticks further behind than this are dropped instead of caught up
+const float CAMERA_SPEED = 150.0f;          // wasd movement in units per second
+const int BENCH_WARMUP_FRAMES = 20;         // unmeasured frames per --bench scene
+const int DEFAULT_BENCH_FRAMES = 200;       // measured frames per --bench scene, override with --bench-frames
+const int PROFILE_RING_SIZE = 4;           // frames of gpu timer queries in flight before they're read
+const int PROFILE_HISTORY = 240;           // frames shown by the profiler overlay
+const int BVH_LEAF_SIZE = 4;             // max primitives per bvh leaf
+const int BVH_MAX_DEPTH = 30;            // keeps traversal within the shader's fixed-size stack
 
-const float THROAT_RADIUS = 25.0f;
 const vec3 THROAT_CENTER = vec3(0, 0, 0);
 const float BENDING_STRENGTH = 0.95f;
 
 int currentUniverse = 1;
+float throatRadius = DEFAULT_THROAT_RADIUS; // from the scene file
+atomic<bool> timePaused{false}; // freezes the animation so a still camera can accumulate samples
+bool profilerOverlay = false; // toggled with O, the engine picks it up at the next frame
+enum LensingMode {
+    LENSING_APPROXIMATE,  // wormhole.comp, refracts rays at the throat
+    LENSING_GEODESIC,     // geodesic.comp, integrates every ray through the metric
+    LENSING_GEODESIC_LUT, // geodesic.comp, looks the lens sphere exit up in the deflection table
+};
+LensingMode lensingMode = LENSING_APPROXIMATE;
+
+// ray cost heatmaps the shaders write instead of the color, must match DEBUG_VIEW_* in scene.glsl
+enum DebugView {
+    DEBUG_VIEW_NONE,
+    DEBUG_VIEW_STEPS,      // geodesic integration steps per pixel
+    DEBUG_VIEW_PRIMITIVES, // spheres and triangles intersection tested per pixel
+    DEBUG_VIEW_STARS,      // stars tested per pixel
+};
+const char* const DEBUG_VIEW_NAMES[] = {"none", "steps", "primitives", "stars"};
+DebugView debugView = DEBUG_VIEW_NONE;
+float geodesicTolerance = DEFAULT_GEODESIC_TOLERANCE; // per-step integration error in geodesic mode, set with --tolerance
+int traceGroupSize = 8; // workgroup edge the trace shaders are compiled with, set with --group-size
 
 //------------------------------------------------------------------------------
 // camera
@@ -56,9 +118,6 @@ struct alignas(16) Camera {
     float _pad3;
     float fov;
     float azimuth, elevation, radius;
-    bool dragging = false;
-    bool panning = false;
-    float lastX = 0, lastY = 0;
 
     Camera() : position(0, 0, 80.0f), target(0, 0, 0), up(0, 1, 0), 
                fov(60.0f), azimuth(0), elevation((float)M_PI / 2.0f), radius(80.0f) {}
@@ -95,39 +154,80 @@ struct alignas(16) Camera {
 
 Camera camera;
 
+// std140 layout of the Frame uniform block shared by wormhole.comp and animate.comp
+struct alignas(16) FrameData {
+    vec3 sunPosU1;
+    float time;
+    vec3 sunColorU1;
+    int currentUniverse;
+    vec3 sunPosU2;
+    int numSpheres;
+    vec3 sunColorU2;
+    int numStars;
+    vec3 meshBoundsMin;
+    int numTriangles;
+    vec3 meshQuantizeScale;
+    int starfieldMode;
+    ivec2 bvhRoots;
+    int starCellGrid;
+    float geodesicTolerance;
+    ivec2 renderExtent; // pixels actually traced, smaller than the target when upsampling
+    vec2 jitter;        // subpixel offset of this frame's samples, in traced pixels
+    int geodesicLut;
+    float lutMaxRadius;
+    int debugView;
+    int _pad1;
+};
+
 //------------------------------------------------------------------------------
 // input handling
 //------------------------------------------------------------------------------
-void processInput(GLFWwindow* window) {
-    float cameraSpeed = 2.5f;
-    vec3 forward = normalize(camera.target - camera.position);
-    vec3 right = normalize(cross(forward, camera.up));
+// the glfw callbacks run on the main thread, the camera moves on the simulation
+// thread. the callbacks leave what happened here and every tick takes it
+enum MoveKey {
+    MOVE_FORWARD = 1 << 0,
+    MOVE_BACK = 1 << 1,
+    MOVE_LEFT = 1 << 2,
+    MOVE_RIGHT = 1 << 3,
+    MOVE_DOWN = 1 << 4,
+    MOVE_UP = 1 << 5,
+};
+
+struct InputState {
+    unsigned heldKeys = 0; // MoveKey bits
+    vec2 orbit = vec2(0.0f); // mouse motion since the last tick, in pixels
+    vec2 pan = vec2(0.0f);
+    float zoom = 0.0f;       // scroll since the last tick
+};
+
+mutex inputMutex;
+InputState input;
+
+// the mouse button state and last cursor position, only used by the callbacks
+struct MouseDrag {
+    bool dragging = false;
+    bool panning = false;
+    float lastX = 0, lastY = 0;
+};
+
+MouseDrag mouseDrag;
+
+// moves position and target together, so the view direction stays the same
+void moveCamera(Camera& cam, unsigned keys, float dt) {
+    float distance = CAMERA_SPEED * dt;
+    vec3 forward = normalize(cam.target - cam.position);
+    vec3 right = normalize(cross(forward, cam.up));
     vec3 localUp = cross(right, forward);
 
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
-        camera.position += forward * cameraSpeed;
-        camera.target += forward * cameraSpeed;
-    }
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) {
-        camera.position -= forward * cameraSpeed;
-        camera.target -= forward * cameraSpeed;
-    }
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) {
-        camera.position -= right * cameraSpeed;
-        camera.target -= right * cameraSpeed;
-    }
-    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) {
-        camera.position += right * cameraSpeed;
-        camera.target += right * cameraSpeed;
-    }
-    if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS) {
-        camera.position -= localUp * cameraSpeed;
-        camera.target -= localUp * cameraSpeed;
-    }
-    if (glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS || glfwGetKey(window, GLFW_KEY_RIGHT_SHIFT) == GLFW_PRESS) {
-        camera.position += localUp * cameraSpeed;
-        camera.target += localUp * cameraSpeed;
-    }
+    vec3 move(0.0f);
+    if (keys & MOVE_FORWARD) move += forward;
+    if (keys & MOVE_BACK) move -= forward;
+    if (keys & MOVE_LEFT) move -= right;
+    if (keys & MOVE_RIGHT) move += right;
+    if (keys & MOVE_DOWN) move -= localUp;
+    if (keys & MOVE_UP) move += localUp;
+    cam.position += move * distance;
+    cam.target += move * distance;
 }
 
 //------------------------------------------------------------------------------
@@ -138,6 +238,7 @@ struct alignas(16) Sphere {
     vec4 color;
     vec4 properties;
     
+    Sphere() = default;
     Sphere(vec3 c, float r, vec3 col, bool emissive = false, int universe = 1) {
         centerAndRadius = vec4(c, r);
         color = vec4(col, 1.0);
@@ -150,54 +251,907 @@ struct alignas(16) Star {
     vec4 colorAndSize;
 };
 
+// orbital parameters for the animation pre-pass in animate.comp
+struct alignas(16) Orbit {
+    vec4 initialPosition; // .w: angular velocity in rad/s, negative orbits backwards, 0 = static
+    vec4 axis;            // .xyz: normalized rotation axis
+};
+
 vector<Sphere> spheres;
 vector<Star> stars;
+vector<Orbit> orbits;
+
+static_assert(sizeof(Sphere) == sizeof(SceneSphere) && sizeof(Star) == sizeof(SceneStar),
+              "scene records must have the layout of the gpu buffers");
+
+// the scene's records already have the buffer layout, so each array is a single copy
+void setupSpheres(const Scene& scene) {
+    spheres.resize(scene.spheres.size());
+    if (!spheres.empty()) {
+        memcpy((void*)spheres.data(), scene.spheres.begin(), spheres.size() * sizeof(Sphere));
+    }
+}
+
+void setupStars(const Scene& scene) {
+    stars.resize(scene.stars.size());
+    if (!stars.empty()) {
+        memcpy((void*)stars.data(), scene.stars.begin(), stars.size() * sizeof(Star));
+    }
+}
+
+// planets circle the y axis of their universe, universe 2 tilted and in reverse,
+// slower the further out they are. suns stay where they are.
+void buildOrbits() {
+    orbits.clear();
+    for (const Sphere& s : spheres) {
+        vec3 initialPos = vec3(s.centerAndRadius);
+        int universeID = int(s.properties.y);
+        bool isEmissive = s.properties.x > 0.5f;
+
+        vec3 rotation_axis = (universeID == 1) ? vec3(0.0, 1.0, 0.0) : vec3(0.1, 1.0, 0.0);
+        float orbit_radius = length(vec3(initialPos.x, 0.0, initialPos.z));
+        float speed_factor = 150.0f;
+        float angular_velocity = 10.0f / (orbit_radius + speed_factor);
+        if (universeID == 2) {
+            angular_velocity = -angular_velocity;
+        }
+
+        orbits.push_back({vec4(initialPos, isEmissive ? 0.0f : angular_velocity), vec4(normalize(rotation_axis), 0.0f)});
+    }
+}
+
+// must match the constants in wormhole.comp
+enum StarfieldMode {
+    STARFIELD_EXACT = 0,   // every background pixel tests every star
+    STARFIELD_CUBEMAP = 1, // stars baked once into a cubemap and sampled per ray
+    STARFIELD_BINNED = 2,  // exact per-star look, but only the stars in the ray's cell are tested
+};
 
+// offset table for binned mode: starCells[c]..starCells[c + 1] indexes the star list of
+// cell c, and the lists follow the 6 * STAR_CELL_GRID^2 + 1 offsets in the same array
+vector<GLuint> starCells;
+
+// a random catalog in place of the scene's, for --stars and the benchmark
 void generateStars(int count) {
-    for (int i = 0; i < count; i++) {
-        vec3 dir = normalize(vec3(
-            (rand() / (float)RAND_MAX) * 2.0f - 1.0f,
-            (rand() / (float)RAND_MAX) * 2.0f - 1.0f,
-            (rand() / (float)RAND_MAX) * 2.0f - 1.0f
-        ));
-        float brightness = (rand() / (float)RAND_MAX) * 0.5f + 0.5f;
-        float size = (rand() / (float)RAND_MAX) * 0.005f + 0.001f;
-
-        float temp = (rand() / (float)RAND_MAX);
-        vec3 color;
-        if (temp < 0.33f) {
-            color = vec3(0.8, 0.8, 1.0); // bluish
-        } else if (temp < 0.66f) {
-            color = vec3(1.0, 1.0, 1.0); // white
+    vector<SceneStar> generated;
+    generateStarCatalog(count, generated);
+    stars.resize(generated.size());
+    if (!stars.empty()) {
+        memcpy((void*)stars.data(), generated.data(), stars.size() * sizeof(Star));
+    }
+}
+
+// projects a direction onto the plane of a cube face (opengl cubemap orientation),
+// returns the major axis component. matches projectToFace in the shaders.
+static float projectToFace(int face, const vec3& d, vec2& st) {
+    float ma;
+    switch (face) {
+        case 0:  ma =  d.x; st = vec2(-d.z, -d.y); break;
+        case 1:  ma = -d.x; st = vec2( d.z, -d.y); break;
+        case 2:  ma =  d.y; st = vec2( d.x,  d.z); break;
+        case 3:  ma = -d.y; st = vec2( d.x, -d.z); break;
+        case 4:  ma =  d.z; st = vec2( d.x, -d.y); break;
+        default: ma = -d.z; st = vec2(-d.x, -d.y); break;
+    }
+    if (ma > 0.0f) st /= ma;
+    return ma;
+}
+
+static int majorFace(const vec3& d) {
+    vec3 a = abs(d);
+    if (a.x >= a.y && a.x >= a.z) return d.x >= 0.0f ? 0 : 1;
+    if (a.y >= a.z) return d.y >= 0.0f ? 2 : 3;
+    return d.z >= 0.0f ? 4 : 5;
+}
+
+static int starCellIndex(int face, const vec2& st) {
+    int i = glm::clamp(int((st.x + 1.0f) * 0.5f * STAR_CELL_GRID), 0, STAR_CELL_GRID - 1);
+    int j = glm::clamp(int((st.y + 1.0f) * 0.5f * STAR_CELL_GRID), 0, STAR_CELL_GRID - 1);
+    return (face * STAR_CELL_GRID + j) * STAR_CELL_GRID + i;
+}
+
+// sorts the stars by cube-face cell and builds the per-cell star lists. a star is
+// listed in every cell its footprint overlaps, including cells on neighbouring faces,
+// so the shader only has to test the cell the ray falls into.
+void buildStarCells() {
+    const int numCells = 6 * STAR_CELL_GRID * STAR_CELL_GRID;
+
+    vector<pair<int, Star>> keyed;
+    keyed.reserve(stars.size());
+    for (const Star& star : stars) {
+        vec3 dir = vec3(star.data);
+        vec2 st;
+        int face = majorFace(dir);
+        projectToFace(face, dir, st);
+        keyed.push_back({starCellIndex(face, st), star});
+    }
+    stable_sort(keyed.begin(), keyed.end(), [](const pair<int, Star>& a, const pair<int, Star>& b) { return a.first < b.first; });
+    for (size_t i = 0; i < stars.size(); ++i) {
+        stars[i] = keyed[i].second;
+    }
+
+    // pass 0 counts list sizes, pass 1 fills the lists
+    vector<GLuint> counts(numCells, 0);
+    vector<GLuint> lists;
+    vector<GLuint> cursor;
+    for (int pass = 0; pass < 2; ++pass) {
+        for (size_t s = 0; s < stars.size(); ++s) {
+            vec3 dir = vec3(stars[s].data);
+            float size = stars[s].colorAndSize.w;
+
+            for (int face = 0; face < 6; ++face) {
+                vec2 st;
+                if (projectToFace(face, dir, st) < 0.5f) continue;
+
+                float reach = size * (1.0f + dot(st, st)) * 1.2f;
+                if (st.x + reach < -1.0f || st.x - reach > 1.0f || st.y + reach < -1.0f || st.y - reach > 1.0f) continue;
+
+                int lo = starCellIndex(face, st - vec2(reach));
+                int hi = starCellIndex(face, st + vec2(reach));
+                int i0 = lo % STAR_CELL_GRID, j0 = (lo / STAR_CELL_GRID) % STAR_CELL_GRID;
+                int i1 = hi % STAR_CELL_GRID, j1 = (hi / STAR_CELL_GRID) % STAR_CELL_GRID;
+                for (int j = j0; j <= j1; ++j) {
+                    for (int i = i0; i <= i1; ++i) {
+                        int cell = (face * STAR_CELL_GRID + j) * STAR_CELL_GRID + i;
+                        if (pass == 0) {
+                            counts[cell]++;
+                        } else {
+                            lists[cursor[cell]++] = (GLuint)s;
+                        }
+                    }
+                }
+            }
+        }
+
+        if (pass == 0) {
+            starCells.assign(numCells + 1, 0);
+            for (int c = 0; c < numCells; ++c) {
+                starCells[c + 1] = starCells[c] + counts[c];
+            }
+            cursor.assign(starCells.begin(), starCells.end() - 1);
+            lists.resize(starCells[numCells]);
+        }
+    }
+
+    // list offsets are relative to the start of the whole array in the shader
+    for (auto& offset : starCells) {
+        offset += numCells + 1;
+    }
+    starCells.insert(starCells.end(), lists.begin(), lists.end());
+}
+
+//------------------------------------------------------------------------------
+// meshes
+//------------------------------------------------------------------------------
+const uint32_t MESH_CACHE_MAGIC = 0x48534d57; // "WMSH"
+const uint32_t MESH_CACHE_VERSION = 1;
+const GLuint MESH_EMISSIVE_BIT = 1u << 24;
+
+// position quantized to 16 bits per axis inside the mesh bounds: x | y << 16, z
+struct MeshVertex {
+    GLuint xy;
+    GLuint z;
+};
+
+// three vertex indices and the face color as rgb8, with MESH_EMISSIVE_BIT on top
+struct MeshTriangle {
+    GLuint v[3];
+    GLuint colorAndFlags;
+};
+
+// indexed triangle mesh in the compact layout wormhole.comp reads directly. all
+// triangles live in universe 1. 24 bytes of vertex data and 16 bytes of index data
+// per triangle fetch, instead of 64 bytes for a padded std430 triangle of vec3s.
+struct Mesh {
+    vec3 boundsMin = vec3(0.0f);
+    vec3 boundsMax = vec3(0.0f);
+    vector<MeshVertex> vertices;
+    vector<MeshTriangle> triangles;
+
+    vec3 quantizeScale() const {
+        return (boundsMax - boundsMin) / 65535.0f;
+    }
+
+    vec3 position(GLuint index) const {
+        const MeshVertex& q = vertices[index];
+        return boundsMin + vec3(float(q.xy & 0xFFFFu), float(q.xy >> 16), float(q.z & 0xFFFFu)) * quantizeScale();
+    }
+};
+
+Mesh mesh;
+
+struct MeshCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    float boundsMin[3];
+    float boundsMax[3];
+    uint32_t numVertices;
+    uint32_t numTriangles;
+};
+
+// the cache lives next to the obj and is only valid for the exact source file it was built from
+static bool sourceStamp(const string& path, uint64_t& size, int64_t& time) {
+    error_code ec;
+    size = filesystem::file_size(path, ec);
+    if (ec) return false;
+    time = (int64_t)filesystem::last_write_time(path, ec).time_since_epoch().count();
+    return !ec;
+}
+
+static bool readMeshCache(const string& cachePath, uint64_t srcSize, int64_t srcTime, Mesh& out) {
+    ifstream in(cachePath, ios::binary);
+    if (!in.is_open()) return false;
+
+    MeshCacheHeader h;
+    if (!in.read(reinterpret_cast<char*>(&h), sizeof(h))) return false;
+    if (h.magic != MESH_CACHE_MAGIC || h.version != MESH_CACHE_VERSION || h.sourceSize != srcSize || h.sourceTime != srcTime) {
+        return false;
+    }
+
+    out.boundsMin = vec3(h.boundsMin[0], h.boundsMin[1], h.boundsMin[2]);
+    out.boundsMax = vec3(h.boundsMax[0], h.boundsMax[1], h.boundsMax[2]);
+    out.vertices.resize(h.numVertices);
+    out.triangles.resize(h.numTriangles);
+    in.read(reinterpret_cast<char*>(out.vertices.data()), (streamsize)(h.numVertices * sizeof(MeshVertex)));
+    in.read(reinterpret_cast<char*>(out.triangles.data()), (streamsize)(h.numTriangles * sizeof(MeshTriangle)));
+    return (bool)in;
+}
+
+static void writeMeshCache(const string& cachePath, uint64_t srcSize, int64_t srcTime, const Mesh& m) {
+    ofstream out(cachePath, ios::binary);
+    if (!out.is_open()) return;
+
+    MeshCacheHeader h = {MESH_CACHE_MAGIC, MESH_CACHE_VERSION, srcSize, srcTime,
+                         {m.boundsMin.x, m.boundsMin.y, m.boundsMin.z},
+                         {m.boundsMax.x, m.boundsMax.y, m.boundsMax.z},
+                         (uint32_t)m.vertices.size(), (uint32_t)m.triangles.size()};
+    out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    out.write(reinterpret_cast<const char*>(m.vertices.data()), (streamsize)(m.vertices.size() * sizeof(MeshVertex)));
+    out.write(reinterpret_cast<const char*>(m.triangles.data()), (streamsize)(m.triangles.size() * sizeof(MeshTriangle)));
+}
+
+static GLuint packColor(const vec3& c, bool emissive) {
+    GLuint r = (GLuint)(glm::clamp(c.r, 0.0f, 1.0f) * 255.0f + 0.5f);
+    GLuint g = (GLuint)(glm::clamp(c.g, 0.0f, 1.0f) * 255.0f + 0.5f);
+    GLuint b = (GLuint)(glm::clamp(c.b, 0.0f, 1.0f) * 255.0f + 0.5f);
+    return r | (g << 8) | (b << 16) | (emissive ? MESH_EMISSIVE_BIT : 0u);
+}
+
+// parses the obj, quantizes every referenced position and merges the ones that end
+// up on the same quantized point, so shared vertices are stored once
+static bool loadObj(const string& path, Mesh& out) {
+    tinyobj::ObjReader reader;
+    if (!reader.ParseFromFile(path)) {
+        cerr << "error: failed to load mesh " << path << ": " << reader.Error() << "\n";
+        return false;
+    }
+    const tinyobj::attrib_t& attrib = reader.GetAttrib();
+    const auto& materials = reader.GetMaterials();
+
+    out = Mesh();
+    out.boundsMin = vec3(1e30f);
+    out.boundsMax = vec3(-1e30f);
+    for (size_t i = 0; i + 2 < attrib.vertices.size(); i += 3) {
+        vec3 p(attrib.vertices[i], attrib.vertices[i + 1], attrib.vertices[i + 2]);
+        out.boundsMin = glm::min(out.boundsMin, p);
+        out.boundsMax = glm::max(out.boundsMax, p);
+    }
+    if (out.boundsMin.x > out.boundsMax.x) {
+        cerr << "error: mesh " << path << " has no vertices\n";
+        return false;
+    }
+    vec3 extent = glm::max(out.boundsMax - out.boundsMin, vec3(1e-6f));
+
+    unordered_map<uint64_t, GLuint> unique;
+    auto vertexIndex = [&](int objIndex) {
+        vec3 p(attrib.vertices[3 * objIndex], attrib.vertices[3 * objIndex + 1], attrib.vertices[3 * objIndex + 2]);
+        vec3 q = glm::clamp((p - out.boundsMin) / extent, 0.0f, 1.0f) * 65535.0f + 0.5f;
+        uint64_t key = (uint64_t)q.x | ((uint64_t)q.y << 16) | ((uint64_t)q.z << 32);
+        auto it = unique.find(key);
+        if (it != unique.end()) return it->second;
+
+        GLuint index = (GLuint)out.vertices.size();
+        out.vertices.push_back({(GLuint)q.x | ((GLuint)q.y << 16), (GLuint)q.z});
+        unique.emplace(key, index);
+        return index;
+    };
+
+    for (const auto& shape : reader.GetShapes()) {
+        size_t offset = 0;
+        for (size_t f = 0; f < shape.mesh.num_face_vertices.size(); ++f) {
+            size_t fv = shape.mesh.num_face_vertices[f];
+            if (fv == 3) {
+                vec3 color(0.7f);
+                bool emissive = false;
+                int mat = f < shape.mesh.material_ids.size() ? shape.mesh.material_ids[f] : -1;
+                if (mat >= 0 && mat < (int)materials.size()) {
+                    color = vec3(materials[mat].diffuse[0], materials[mat].diffuse[1], materials[mat].diffuse[2]);
+                    vec3 emission(materials[mat].emission[0], materials[mat].emission[1], materials[mat].emission[2]);
+                    if (dot(emission, emission) > 0.0f) {
+                        color = emission;
+                        emissive = true;
+                    }
+                }
+
+                MeshTriangle tri;
+                for (int k = 0; k < 3; ++k) {
+                    tri.v[k] = vertexIndex(shape.mesh.indices[offset + k].vertex_index);
+                }
+                tri.colorAndFlags = packColor(color, emissive);
+                if (tri.v[0] != tri.v[1] && tri.v[1] != tri.v[2] && tri.v[0] != tri.v[2]) {
+                    out.triangles.push_back(tri);
+                }
+            }
+            offset += fv;
+        }
+    }
+    out.boundsMax = out.boundsMin + extent;
+    return true;
+}
+
+// loads a mesh through its binary cache, rebuilding the cache from the obj when it's
+// missing or stale. scale and offset are applied to the bounds only, the quantized
+// data stays the same.
+bool loadMesh(const string& path, float scale, const vec3& offset) {
+    uint64_t srcSize = 0;
+    int64_t srcTime = 0;
+    if (!sourceStamp(path, srcSize, srcTime)) {
+        cerr << "error: mesh file not found: " << path << "\n";
+        return false;
+    }
+
+    string cachePath = path + ".wmesh";
+    auto t_start = chrono::high_resolution_clock::now();
+    bool cached = readMeshCache(cachePath, srcSize, srcTime, mesh);
+    if (!cached) {
+        if (!loadObj(path, mesh)) return false;
+        writeMeshCache(cachePath, srcSize, srcTime, mesh);
+    }
+    double elapsed = chrono::duration<double>(chrono::high_resolution_clock::now() - t_start).count();
+
+    mesh.boundsMin = mesh.boundsMin * scale + offset;
+    mesh.boundsMax = mesh.boundsMax * scale + offset;
+
+    cout << "loaded mesh " << path << (cached ? " from cache" : "") << ": " << mesh.vertices.size() << " vertices, "
+         << mesh.triangles.size() << " triangles in " << fixed << setprecision(2) << elapsed * 1000.0 << " ms\n";
+    cout.unsetf(ios::fixed);
+    return true;
+}
+
+//------------------------------------------------------------------------------
+// acceleration structure
+//------------------------------------------------------------------------------
+const GLuint BVH_TRIANGLE_BIT = 0x80000000u; // primitive ref flag, the rest is the index
+
+// std430 layout of BVHNode in wormhole.comp. inner nodes have count == 0 and their
+// children at leftOrFirst and leftOrFirst + 1, leaves index count primitive refs.
+struct BVHNode {
+    vec3 boundsMin;
+    int leftOrFirst;
+    vec3 boundsMax;
+    int count;
+};
+
+// binned-sah bvh over spheres and triangles with one root per universe, so the
+// shader never has to filter primitives by universe. the topology is built once on
+// the cpu; animate.comp refits the bounds on the gpu every frame, level by level
+// from the leaves up, following refitOrder.
+struct BVH {
+    vector<BVHNode> nodes;
+    vector<GLuint> primRefs;
+    vector<int> nodeDepth;
+    vector<GLint> refitOrder;   // node indices grouped by depth, deepest first
+    vector<int> refitLevels;    // refitOrder[refitLevels[k]..refitLevels[k + 1]] is one level
+    int roots[2] = {-1, -1};
+
+    static void primBounds(GLuint ref, vec3& lo, vec3& hi) {
+        if (ref & BVH_TRIANGLE_BIT) {
+            const MeshTriangle& t = mesh.triangles[ref & ~BVH_TRIANGLE_BIT];
+            vec3 v0 = mesh.position(t.v[0]), v1 = mesh.position(t.v[1]), v2 = mesh.position(t.v[2]);
+            lo = glm::min(v0, glm::min(v1, v2));
+            hi = glm::max(v0, glm::max(v1, v2));
         } else {
-            color = vec3(1.0, 1.0, 0.8); // yellowish
+            const Sphere& s = spheres[ref];
+            lo = vec3(s.centerAndRadius) - vec3(s.centerAndRadius.w);
+            hi = vec3(s.centerAndRadius) + vec3(s.centerAndRadius.w);
+        }
+    }
+
+    static float surfaceArea(const vec3& lo, const vec3& hi) {
+        vec3 e = glm::max(hi - lo, vec3(0.0f));
+        return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+    }
+
+    void build() {
+        nodes.clear();
+        primRefs.clear();
+        nodeDepth.clear();
+
+        for (int u = 1; u <= 2; ++u) {
+            size_t first = primRefs.size();
+            for (size_t i = 0; i < spheres.size(); ++i) {
+                if (int(spheres[i].properties.y) == u) primRefs.push_back((GLuint)i);
+            }
+            if (u == 1) {
+                for (size_t i = 0; i < mesh.triangles.size(); ++i) {
+                    primRefs.push_back((GLuint)i | BVH_TRIANGLE_BIT);
+                }
+            }
+
+            int count = (int)(primRefs.size() - first);
+            if (count == 0) {
+                roots[u - 1] = -1;
+                continue;
+            }
+            roots[u - 1] = (int)nodes.size();
+            nodes.push_back({});
+            nodeDepth.push_back(0);
+            subdivide(roots[u - 1], (int)first, count, 0);
         }
 
-        stars.push_back({vec4(dir, brightness), vec4(color, size)});
+        int maxDepth = nodeDepth.empty() ? -1 : *std::max_element(nodeDepth.begin(), nodeDepth.end());
+        refitOrder.clear();
+        refitLevels.clear();
+        for (int d = maxDepth; d >= 0; --d) {
+            refitLevels.push_back((int)refitOrder.size());
+            for (size_t i = 0; i < nodes.size(); ++i) {
+                if (nodeDepth[i] == d) refitOrder.push_back((GLint)i);
+            }
+        }
+        refitLevels.push_back((int)refitOrder.size());
+    }
+
+    void subdivide(int nodeIndex, int first, int count, int depth) {
+        const int NUM_BINS = 12;
+
+        vec3 lo(1e30f), hi(-1e30f), clo(1e30f), chi(-1e30f);
+        for (int i = first; i < first + count; ++i) {
+            vec3 plo, phi;
+            primBounds(primRefs[i], plo, phi);
+            lo = glm::min(lo, plo);
+            hi = glm::max(hi, phi);
+            vec3 c = (plo + phi) * 0.5f;
+            clo = glm::min(clo, c);
+            chi = glm::max(chi, c);
+        }
+        nodes[nodeIndex] = {lo, first, hi, count};
+        if (count <= BVH_LEAF_SIZE || depth >= BVH_MAX_DEPTH) return;
+
+        // evaluate bin boundaries along every axis and keep the cheapest split
+        int bestAxis = -1, bestSplit = 0;
+        float bestCost = count * surfaceArea(lo, hi);
+        for (int axis = 0; axis < 3; ++axis) {
+            float extent = chi[axis] - clo[axis];
+            if (extent <= 0.0f) continue;
+
+            int binCount[NUM_BINS] = {};
+            vec3 binLo[NUM_BINS], binHi[NUM_BINS];
+            for (int b = 0; b < NUM_BINS; ++b) {
+                binLo[b] = vec3(1e30f);
+                binHi[b] = vec3(-1e30f);
+            }
+            for (int i = first; i < first + count; ++i) {
+                vec3 plo, phi;
+                primBounds(primRefs[i], plo, phi);
+                float c = (plo[axis] + phi[axis]) * 0.5f;
+                int b = std::min(NUM_BINS - 1, int((c - clo[axis]) / extent * NUM_BINS));
+                binCount[b]++;
+                binLo[b] = glm::min(binLo[b], plo);
+                binHi[b] = glm::max(binHi[b], phi);
+            }
+
+            for (int split = 1; split < NUM_BINS; ++split) {
+                vec3 llo(1e30f), lhi(-1e30f), rlo(1e30f), rhi(-1e30f);
+                int lcount = 0, rcount = 0;
+                for (int b = 0; b < split; ++b) {
+                    if (!binCount[b]) continue;
+                    lcount += binCount[b];
+                    llo = glm::min(llo, binLo[b]);
+                    lhi = glm::max(lhi, binHi[b]);
+                }
+                for (int b = split; b < NUM_BINS; ++b) {
+                    if (!binCount[b]) continue;
+                    rcount += binCount[b];
+                    rlo = glm::min(rlo, binLo[b]);
+                    rhi = glm::max(rhi, binHi[b]);
+                }
+                if (lcount == 0 || rcount == 0) continue;
+
+                float cost = lcount * surfaceArea(llo, lhi) + rcount * surfaceArea(rlo, rhi);
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = split;
+                }
+            }
+        }
+        if (bestAxis < 0) return;
+
+        float extent = chi[bestAxis] - clo[bestAxis];
+        auto mid = std::partition(primRefs.begin() + first, primRefs.begin() + first + count, [&](GLuint ref) {
+            vec3 plo, phi;
+            primBounds(ref, plo, phi);
+            float c = (plo[bestAxis] + phi[bestAxis]) * 0.5f;
+            return std::min(NUM_BINS - 1, int((c - clo[bestAxis]) / extent * NUM_BINS)) < bestSplit;
+        });
+        int leftCount = (int)(mid - (primRefs.begin() + first));
+
+        int left = (int)nodes.size();
+        nodes.push_back({});
+        nodes.push_back({});
+        nodeDepth.push_back(depth + 1);
+        nodeDepth.push_back(depth + 1);
+        nodes[nodeIndex].leftOrFirst = left;
+        nodes[nodeIndex].count = 0;
+
+        subdivide(left, first, leftCount, depth + 1);
+        subdivide(left + 1, first + leftCount, count - leftCount, depth + 1);
+    }
+};
+
+BVH bvh;
+
+//------------------------------------------------------------------------------
+// shader programs
+//------------------------------------------------------------------------------
+const uint32_t PROGRAM_CACHE_MAGIC = 0x50474857; // "WHGP"
+const char* const PROGRAM_CACHE_DIR = "shader_cache";
+const double SHADER_POLL_INTERVAL = 0.5; // seconds between checks for edited trace shaders
+
+// a linked program as returned by glGetProgramBinary. the file name is a hash of the
+// preprocessed source and the driver, so an edited shader or a driver update just misses
+struct ProgramCacheHeader {
+    uint32_t magic;
+    uint32_t format; // binary format enum of the driver that wrote it
+    uint32_t length;
+};
+
+static uint64_t hashString(const string& text, uint64_t hash = 14695981039346656037ull) {
+    for (unsigned char c : text) {
+        hash = (hash ^ c) * 1099511628211ull; // fnv-1a
+    }
+    return hash;
+}
+
+// latest write time of a shader and its includes, to notice edits while running
+static filesystem::file_time_type newestWriteTime(const vector<string>& files) {
+    filesystem::file_time_type newest = filesystem::file_time_type::min();
+    for (const string& file : files) {
+        error_code ec;
+        auto time = filesystem::last_write_time(file, ec);
+        if (!ec && time > newest) newest = time;
     }
+    return newest;
 }
 
 //------------------------------------------------------------------------------
 // gpu renderer
 //------------------------------------------------------------------------------
+// per-frame timings of the engine's passes, on the cpu with steady_clock and on the
+// gpu with GL_TIME_ELAPSED queries. queries are only read back PROFILE_RING_SIZE
+// frames later once GL_QUERY_RESULT_AVAILABLE says so, so profiling never waits on
+// the gpu; a frame whose queries still aren't done by then loses its gpu times.
+// a section may run several times per frame (movie mode traces --spp samples), its
+// times are summed. sections must not nest, gl allows one elapsed query at a time
+enum ProfileSection { PROFILE_ANIMATE, PROFILE_UPLOAD, PROFILE_TRACE, PROFILE_BLIT, PROFILE_READBACK, PROFILE_SECTIONS };
+const char* const PROFILE_SECTION_NAMES[PROFILE_SECTIONS] = {"animate", "upload", "trace", "blit", "readback"};
+const vec3 PROFILE_SECTION_COLORS[PROFILE_SECTIONS] = {
+    vec3(0.9f, 0.3f, 0.3f), vec3(0.9f, 0.8f, 0.2f), vec3(0.3f, 0.8f, 0.3f), vec3(0.3f, 0.5f, 1.0f), vec3(0.8f, 0.4f, 0.9f)};
+
+struct FrameProfiler {
+    struct FrameTimes {
+        int frame = -1;
+        double frameMs = 0.0; // cpu time from this frame's start to the next one's
+        double cpuMs[PROFILE_SECTIONS] = {};
+        double gpuMs[PROFILE_SECTIONS] = {}; // negative when the queries never became available
+    };
+    struct Slot {
+        FrameTimes times;
+        vector<GLuint> queries[PROFILE_SECTIONS];
+        int used[PROFILE_SECTIONS] = {};
+        bool pending = false;
+    };
+
+    bool enabled = false; // queries are only issued while the overlay or the csv wants them
+    bool showOverlay = false;
+    Slot slots[PROFILE_RING_SIZE];
+    int frame = -1;
+    chrono::steady_clock::time_point frameStart, sectionStart[PROFILE_SECTIONS];
+    ofstream csv;
+
+    // resolved frames, newest at historyHead - 1, for the overlay and the window title
+    FrameTimes history[PROFILE_HISTORY];
+    int historyHead = 0, historyCount = 0;
+
+    bool openCsv(const string& path) {
+        csv.open(path);
+        if (!csv.is_open()) {
+            return false;
+        }
+        csv << "frame,frame_ms";
+        for (const char* name : PROFILE_SECTION_NAMES) {
+            csv << "," << name << "_cpu_ms," << name << "_gpu_ms";
+        }
+        csv << "\n";
+        return true;
+    }
+
+    Slot& current() { return slots[frame % PROFILE_RING_SIZE]; }
+
+    // closes the previous frame and starts recording the next one
+    void nextFrame() {
+        auto now = chrono::steady_clock::now();
+        if (frame >= 0 && current().pending) {
+            current().times.frameMs = chrono::duration<double, milli>(now - frameStart).count();
+        }
+        collect(false);
+        frame++;
+        frameStart = now;
+        enabled = showOverlay || csv.is_open(); // only changes between frames, never inside a section
+        if (!enabled) {
+            return;
+        }
+
+        Slot& slot = current();
+        if (slot.pending) {
+            resolve(slot, false); // still in flight after a whole ring of frames, give up on it
+        }
+        slot.times = FrameTimes();
+        slot.times.frame = frame;
+        for (int& u : slot.used) u = 0;
+        slot.pending = true;
+    }
+
+    void begin(ProfileSection s) {
+        if (!enabled || frame < 0) return;
+        Slot& slot = current();
+        if (slot.used[s] == (int)slot.queries[s].size()) {
+            GLuint q;
+            glGenQueries(1, &q);
+            slot.queries[s].push_back(q);
+        }
+        glBeginQuery(GL_TIME_ELAPSED, slot.queries[s][slot.used[s]++]);
+        sectionStart[s] = chrono::steady_clock::now();
+    }
+
+    void end(ProfileSection s) {
+        if (!enabled || frame < 0) return;
+        glEndQuery(GL_TIME_ELAPSED);
+        current().times.cpuMs[s] += chrono::duration<double, milli>(chrono::steady_clock::now() - sectionStart[s]).count();
+    }
+
+    // resolves finished frames oldest first, so the csv stays in frame order. with wait
+    // set it blocks until every pending frame is in, for the end of a run
+    void collect(bool wait) {
+        for (int f = std::max(0, frame - PROFILE_RING_SIZE + 1); f <= frame; ++f) {
+            Slot& slot = slots[f % PROFILE_RING_SIZE];
+            if (!slot.pending || slot.times.frame != f) continue;
+            if (!wait && !available(slot)) break;
+            resolve(slot, true);
+        }
+    }
+
+    bool available(const Slot& slot) const {
+        for (int s = 0; s < PROFILE_SECTIONS; ++s) {
+            if (slot.used[s] > 0) {
+                GLuint ready = 0;
+                glGetQueryObjectuiv(slot.queries[s][slot.used[s] - 1], GL_QUERY_RESULT_AVAILABLE, &ready);
+                if (!ready) return false;
+            }
+        }
+        return true;
+    }
+
+    void resolve(Slot& slot, bool readQueries) {
+        FrameTimes& t = slot.times;
+        for (int s = 0; s < PROFILE_SECTIONS; ++s) {
+            t.gpuMs[s] = readQueries ? 0.0 : -1.0;
+            for (int i = 0; readQueries && i < slot.used[s]; ++i) {
+                GLuint64 ns = 0;
+                glGetQueryObjectui64v(slot.queries[s][i], GL_QUERY_RESULT, &ns);
+                t.gpuMs[s] += (double)ns * 1e-6;
+            }
+        }
+        slot.pending = false;
+
+        history[historyHead] = t;
+        historyHead = (historyHead + 1) % PROFILE_HISTORY;
+        historyCount = std::min(historyCount + 1, PROFILE_HISTORY);
+
+        if (csv.is_open()) {
+            csv << t.frame << "," << t.frameMs;
+            for (int s = 0; s < PROFILE_SECTIONS; ++s) {
+                csv << "," << t.cpuMs[s] << ",";
+                if (t.gpuMs[s] >= 0.0) csv << t.gpuMs[s];
+            }
+            csv << "\n";
+        }
+    }
+
+    void finish() {
+        if (frame >= 0 && current().pending) {
+            current().times.frameMs = chrono::duration<double, milli>(chrono::steady_clock::now() - frameStart).count();
+        }
+        collect(true);
+        csv.close();
+    }
+
+    // mean gpu time per section over the last frames, for the window title
+    string summary(int frames) const {
+        double sum[PROFILE_SECTIONS] = {};
+        int n = std::min(frames, historyCount);
+        for (int i = 0; i < n; ++i) {
+            const FrameTimes& t = history[(historyHead - 1 - i + PROFILE_HISTORY) % PROFILE_HISTORY];
+            for (int s = 0; s < PROFILE_SECTIONS; ++s) sum[s] += std::max(0.0, t.gpuMs[s]);
+        }
+        stringstream ss;
+        ss << fixed << setprecision(2) << "gpu ms";
+        for (int s = 0; s < PROFILE_SECTIONS; ++s) {
+            ss << " " << PROFILE_SECTION_NAMES[s] << " " << (n > 0 ? sum[s] / n : 0.0);
+        }
+        return ss.str();
+    }
+
+    // a scrolling graph in the bottom left corner: one column per frame, the gpu
+    // sections stacked in their colors, a white tick at the cpu frame time and a gray
+    // line at the target frame time. drawn with scissored clears, so it needs no shader
+    void drawOverlay(int fbWidth, int fbHeight, double targetMs) {
+        const int columnWidth = 2, graphHeight = std::min(200, fbHeight / 3), margin = 8;
+        const double pixelsPerMs = graphHeight / (2.0 * targetMs); // the target sits halfway up
+        glEnable(GL_SCISSOR_TEST);
+        auto rect = [&](int x, int y, int w, int h, vec3 c) {
+            if (w <= 0 || h <= 0) return;
+            glScissor(x, y, w, h);
+            glClearColor(c.r, c.g, c.b, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT);
+        };
+
+        int graphWidth = std::min(PROFILE_HISTORY * columnWidth, fbWidth - 2 * margin);
+        rect(margin, margin, graphWidth, graphHeight, vec3(0.05f));
+        int columns = std::min(historyCount, graphWidth / columnWidth);
+        for (int i = 0; i < columns; ++i) {
+            const FrameTimes& t = history[(historyHead - 1 - i + PROFILE_HISTORY) % PROFILE_HISTORY];
+            int x = margin + graphWidth - (i + 1) * columnWidth;
+            int y = margin;
+            for (int s = 0; s < PROFILE_SECTIONS; ++s) {
+                int h = std::min((int)(std::max(0.0, t.gpuMs[s]) * pixelsPerMs + 0.5), margin + graphHeight - y);
+                rect(x, y, columnWidth, h, PROFILE_SECTION_COLORS[s]);
+                y += std::max(0, h);
+            }
+            int tick = std::min((int)(t.frameMs * pixelsPerMs), graphHeight - 1);
+            rect(x, margin + tick, columnWidth, 1, vec3(1.0f));
+        }
+        rect(margin, margin + graphHeight / 2, graphWidth, 1, vec3(0.5f));
+
+        glDisable(GL_SCISSOR_TEST);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    }
+};
+
 struct Engine {
     GLFWwindow* window;
     GLuint quadVAO, quadVBO;
-    GLuint texture;
+    GLuint texture;        // final full resolution image, displayed and read back
+    GLuint historyTexture; // previous frame's output, reprojected by upsample.comp
+    GLuint lowResTexture;  // traced image when rendering below the output resolution or accumulating
+    GLuint accumTexture;   // running sum of the jittered samples of a still view
     GLuint shaderProgram;
+    int width, height; // render resolution, follows the framebuffer in interactive mode
     vector<unsigned char> pixels;
 
-    GLuint computeShaderProgram;
+    // wormhole.comp, or geodesic.comp to integrate the real metric instead of refracting,
+    // compiled per combination of the settings traceDefines bakes in. each variant is
+    // built the first time it's used and rebuilt when one of its files changes
+    struct ShaderVariant {
+        string path;
+        string defines;
+        GLuint program = 0;
+        vector<string> files; // the shader and everything it includes, empty until tried
+        filesystem::file_time_type writeTime;
+    };
+    map<string, ShaderVariant> traceVariants; // by path and defines
+    GLuint deflectionLut = 0; // DeflectionTable for LENSING_GEODESIC_LUT, built the first time it's used
     GLuint cameraUBO;
-    GLuint spheresSSBO;
+    GLuint prevCameraUBO;
+    GLuint frameUBO;
+    int sunIndex[2] = {-1, -1}; // emissive sphere lighting each universe, resolved per scene
+    GLuint spheresSSBO;       // animated spheres, written by animate.comp
+    GLuint sourceSpheresSSBO; // the scene's spheres, which the animation starts from
+    GLuint orbitsSSBO;
     GLuint starsSSBO;
+    GLuint starCellsSSBO;
+    GLuint meshTrianglesSSBO;
+    GLuint meshVerticesSSBO;
+    GLuint bvhNodesSSBO;
+    GLuint refitOrderSSBO;
+    GLuint bvhPrimsSSBO;
+
+    // frame totals of the ray cost counters in a debug view, in a ring of buffers like
+    // the profiler's queries: a buffer is only read PROFILE_RING_SIZE traces later, and
+    // only if its fence says the gpu is done with it, so the cpu never waits
+    GLuint costSSBOs[PROFILE_RING_SIZE];
+    GLsync costFences[PROFILE_RING_SIZE] = {};
+    int costSlot = 0;
+    double costPerPixel[3] = {}; // steps, primitives and stars per traced pixel, last frame
+
+    GLuint animateProgram;
+    GLint animatePassLoc, refitBeginLoc, refitEndLoc;
+    GLuint starfieldBakeProgram;
+    GLuint starfieldCubemap;
+    StarfieldMode starfieldMode = STARFIELD_CUBEMAP;
+
+    GLuint quantizeShaderProgram;
+    GLuint quantizedTexture;
+    GLuint halfShaderProgram; // quantize.comp with QUANTIZE_HALF, for --hdr
+    GLuint halfTexture;
+
+    // dynamic resolution: the controller scales the traced resolution to hold the target
+    // frame time, and upsample.comp reconstructs the full image from it and the history
+    GLuint upsampleProgram;
+    GLint historyValidLoc;
+    bool dynamicResolution = false;
+    float targetFrameTime = 1.0f / DEFAULT_TARGET_FPS;
+    float renderScale = 1.0f;
+    float smoothedFrameTime = 0.0f;
+    float scaleTimer = 0.0f;
+    ivec2 renderExtent;
+    bool historyValid = false;
+    int historyUniverse = 0;
+    unsigned int frameIndex = 0;
+    Camera prevCamera;
+
+    // progressive accumulation: while the view stays the same, every frame adds one
+    // jittered sample per pixel into accumTexture instead of retracing the same rays
+    GLuint accumulateProgram;
+    GLint sampleIndexLoc;
+    bool accumulation = false;
+    int stillFrames = 0; // consecutive frames showing the same view, 1 when it just changed
+    Camera accumCamera;
+    float accumTime = 0.0f;
+    int accumUniverse = 0;
+    LensingMode accumLensing = LENSING_APPROXIMATE;
+    DebugView accumDebugView = DEBUG_VIEW_NONE;
+    bool gpuQuantize = true; // movie readback as rgba8 quantized on the gpu instead of rgba32f
+    bool hdrReadback = false; // movie readback as unclamped rgba16f, flipped on the gpu, for --hdr
+
+    GLuint readbackPBOs[READBACK_RING_SIZE];
+    GLsync readbackFences[READBACK_RING_SIZE];
+    size_t readbackSize = 0;
     
-    Engine() {
-        pixels.resize(WIDTH * HEIGHT * 3);
+    // headless: no window and no presentation, for movie renders on servers without a
+    // display. with EGL the context lives on the gpu directly, otherwise in a hidden window
+    bool headless;
+    int device; // egl device the headless context lives on
+#ifdef WORMHOLE_EGL
+    EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+    EGLContext eglContext = EGL_NO_CONTEXT;
+#endif
+
+    // the view traced every frame. the extra engines of a multi-gpu movie each render
+    // their own frames, so they point this at a camera of their own
+    const Camera* view = &camera;
+
+    FrameProfiler profiler;
+
+    Engine(int w, int h, bool offscreen = false, int gpu = 0)
+        : window(nullptr), width(w), height(h), headless(offscreen), device(gpu) {
+        pixels.resize((size_t)width * height * 3);
+#ifdef WORMHOLE_EGL
+        if (headless) {
+            initEGL();
+        } else {
+            initGLFW();
+        }
+#else
         initGLFW();
+#endif
+        initGLEW();
         initShaders();
         initQuad();
         initCompute();
+        initReadback();
     }
     
     void initGLFW() {
@@ -209,8 +1163,11 @@ struct Engine {
         glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
         glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
         glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        if (headless) {
+            glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        }
         
-        window = glfwCreateWindow(WIDTH, HEIGHT, "Wormhole Simulation", nullptr, nullptr);
+        window = glfwCreateWindow(width, height, "Wormhole Simulation", nullptr, nullptr);
         if (!window) {
             cerr << "failed to create window\n";
             glfwTerminate();
@@ -218,9 +1175,79 @@ struct Engine {
         }
         
         glfwMakeContextCurrent(window);
+    }
+
+#ifdef WORMHOLE_EGL
+    // gpus the headless contexts can be created on, 0 without device enumeration
+    static int eglDeviceCount() {
+        auto queryDevices = (PFNEGLQUERYDEVICESEXTPROC)eglGetProcAddress("eglQueryDevicesEXT");
+        EGLint numDevices = 0;
+        if (!queryDevices || !queryDevices(0, nullptr, &numDevices)) {
+            return 0;
+        }
+        return std::min((int)numDevices, MAX_EGL_DEVICES);
+    }
+
+    // a 4.3 core context on egl device number device, without any surface
+    void initEGL() {
+        auto queryDevices = (PFNEGLQUERYDEVICESEXTPROC)eglGetProcAddress("eglQueryDevicesEXT");
+        auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        EGLDeviceEXT devices[MAX_EGL_DEVICES];
+        EGLint numDevices = 0;
+        if (queryDevices && getPlatformDisplay && queryDevices(MAX_EGL_DEVICES, devices, &numDevices) && numDevices > 0) {
+            eglDisplay = getPlatformDisplay(EGL_PLATFORM_DEVICE_EXT, devices[std::min(device, (int)numDevices - 1)], nullptr);
+        } else {
+            eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        }
+
+        EGLint major, minor;
+        if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, &major, &minor)) {
+            cerr << "failed to initialize egl\n";
+            exit(EXIT_FAILURE);
+        }
+
+        const EGLint configAttribs[] = {EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+        EGLConfig config;
+        EGLint numConfigs = 0;
+        const EGLint contextAttribs[] = {EGL_CONTEXT_MAJOR_VERSION, 4, EGL_CONTEXT_MINOR_VERSION, 3,
+                                         EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE};
+        if (!eglChooseConfig(eglDisplay, configAttribs, &config, 1, &numConfigs) || numConfigs == 0 ||
+            !eglBindAPI(EGL_OPENGL_API) ||
+            (eglContext = eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT, contextAttribs)) == EGL_NO_CONTEXT ||
+            !eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, eglContext)) {
+            cerr << "failed to create a headless opengl 4.3 context\n";
+            exit(EXIT_FAILURE);
+        }
+        cout << "egl " << major << "." << minor << ", headless on device " << device << "\n";
+    }
+
+    // a context is current on one thread at a time, so a render thread takes it over
+    // with makeCurrent after the thread that created it released it
+    void makeCurrent() { eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, eglContext); }
+    void releaseCurrent() { eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT); }
+
+    void destroyContext() {
+        if (eglDisplay == EGL_NO_DISPLAY) {
+            return;
+        }
+        releaseCurrent();
+        eglDestroyContext(eglDisplay, eglContext);
+        eglTerminate(eglDisplay);
+        eglDisplay = EGL_NO_DISPLAY;
+    }
+#endif
+
+    void initGLEW() {
         glewExperimental = GL_TRUE;
-        
-        if (glewInit() != GLEW_OK) {
+        GLenum status = glewInit();
+#if defined(WORMHOLE_EGL) && defined(GLEW_ERROR_NO_GLX_DISPLAY)
+        // glew built for glx still loads the gl entry points of an egl context, it only
+        // fails to find an x display for its glx extensions (reported since glew 2.2)
+        if (headless && status == GLEW_ERROR_NO_GLX_DISPLAY) {
+            status = GLEW_OK;
+        }
+#endif
+        if (status != GLEW_OK) {
             cerr << "failed to initialize glew\n";
             exit(EXIT_FAILURE);
         }
@@ -265,21 +1292,115 @@ struct Engine {
         glDeleteShader(frag);
     }
     
-    string readShaderFromFile(const string& path) {
+    // reads a shader and splices in its #include "file" lines, relative to the including
+    // file, so the compute shaders can share their declarations. files collects the paths read
+    string readShaderFromFile(const string& path, vector<string>* files = nullptr, int depth = 0) {
+        if (files) {
+            files->push_back(path); // a missing file too, so it's picked up once it exists
+        }
         ifstream file(path);
         if (!file.is_open()) {
             cerr << "error: could not open shader file: " << path << endl;
             return "";
         }
+        if (depth > 8) {
+            cerr << "error: shader includes nested too deep: " << path << endl;
+            return "";
+        }
+
+        filesystem::path dir = filesystem::path(path).parent_path();
         stringstream buffer;
-        buffer << file.rdbuf();
+        string line;
+        while (getline(file, line)) {
+            size_t start = line.find_first_not_of(" \t");
+            if (start != string::npos && line.compare(start, 8, "#include") == 0) {
+                size_t open = line.find('"', start);
+                size_t close = open == string::npos ? string::npos : line.find('"', open + 1);
+                if (close != string::npos) {
+                    buffer << readShaderFromFile((dir / line.substr(open + 1, close - open - 1)).string(), files, depth + 1) << "\n";
+                    continue;
+                }
+            }
+            buffer << line << "\n";
+        }
         return buffer.str();
     }
 
-    void initCompute() {
-        string computeShaderSource = readShaderFromFile("wormhole.comp");
-        const char* css_c = computeShaderSource.c_str();
+    bool programBinariesSupported() const {
+        if (!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary) {
+            return false;
+        }
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        return formats > 0;
+    }
+
+    string programCachePath(const string& source) const {
+        string driver = string((const char*)glGetString(GL_RENDERER)) + "\n" + (const char*)glGetString(GL_VERSION);
+        stringstream name;
+        name << PROGRAM_CACHE_DIR << "/" << hex << setw(16) << setfill('0') << hashString(driver, hashString(source)) << ".bin";
+        return name.str();
+    }
+
+    // the driver may reject a binary it wrote itself, e.g. after an update that kept the
+    // version string, so a failed load just falls back to compiling
+    GLuint loadCachedProgram(const string& cachePath) {
+        ifstream in(cachePath, ios::binary);
+        if (!in.is_open()) return 0;
+        ProgramCacheHeader h;
+        if (!in.read(reinterpret_cast<char*>(&h), sizeof(h)) || h.magic != PROGRAM_CACHE_MAGIC) return 0;
+        vector<char> binary(h.length);
+        if (!in.read(binary.data(), (streamsize)binary.size())) return 0;
+
+        GLuint program = glCreateProgram();
+        glProgramBinary(program, h.format, binary.data(), (GLsizei)binary.size());
+        int success;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success) {
+            glDeleteProgram(program);
+            return 0;
+        }
+        return program;
+    }
 
+    void storeCachedProgram(const string& cachePath, GLuint program) {
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0) return;
+        vector<char> binary(length);
+        ProgramCacheHeader h = {PROGRAM_CACHE_MAGIC, 0, 0};
+        GLenum format = 0;
+        glGetProgramBinary(program, length, &length, &format, binary.data());
+        h.format = format;
+        h.length = (uint32_t)length;
+
+        error_code ec;
+        filesystem::create_directories(PROGRAM_CACHE_DIR, ec);
+        ofstream out(cachePath, ios::binary);
+        if (!out.is_open()) return;
+        out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+        out.write(binary.data(), length);
+    }
+
+    // compiles a compute shader with defines inserted right after its #version line, or
+    // loads the program binary a previous run cached for the same source. returns 0 when
+    // it doesn't compile
+    GLuint createComputeProgram(const string& path, const string& defines = "", vector<string>* files = nullptr) {
+        string computeShaderSource = readShaderFromFile(path, files);
+        if (!defines.empty()) {
+            size_t versionEnd = computeShaderSource.find('\n') + 1;
+            computeShaderSource.insert(versionEnd, defines + "#line 2\n");
+        }
+
+        bool binaries = programBinariesSupported();
+        string cachePath = binaries ? programCachePath(computeShaderSource) : "";
+        if (binaries) {
+            if (GLuint program = loadCachedProgram(cachePath)) {
+                return program;
+            }
+        }
+
+        const char* css_c = computeShaderSource.c_str();
         GLuint computeShader = glCreateShader(GL_COMPUTE_SHADER);
         glShaderSource(computeShader, 1, &css_c, NULL);
         glCompileShader(computeShader);
@@ -289,44 +1410,252 @@ struct Engine {
         glGetShaderiv(computeShader, GL_COMPILE_STATUS, &success);
         if (!success) {
             glGetShaderInfoLog(computeShader, 1024, NULL, infoLog);
-            cerr << "error: compute shader compilation failed\n" << infoLog << endl;
+            cerr << "error: compute shader compilation failed (" << path << ")\n" << infoLog << endl;
+            glDeleteShader(computeShader);
+            return 0;
         }
 
-        computeShaderProgram = glCreateProgram();
-        glAttachShader(computeShaderProgram, computeShader);
-        glLinkProgram(computeShaderProgram);
+        GLuint program = glCreateProgram();
+        if (binaries) {
+            glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        }
+        glAttachShader(program, computeShader);
+        glLinkProgram(program);
+        glDeleteShader(computeShader);
 
-        glGetProgramiv(computeShaderProgram, GL_LINK_STATUS, &success);
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
         if (!success) {
-            glGetProgramInfoLog(computeShaderProgram, 1024, NULL, infoLog);
-            cerr << "error: compute shader linking failed\n" << infoLog << endl;
+            glGetProgramInfoLog(program, 1024, NULL, infoLog);
+            cerr << "error: compute shader linking failed (" << path << ")\n" << infoLog << endl;
+            glDeleteProgram(program);
+            return 0;
         }
-        glDeleteShader(computeShader);
+        if (binaries) {
+            storeCachedProgram(cachePath, program);
+        }
+        return program;
+    }
+
+    // the compile time settings of the trace shaders, see the #ifndef defaults in scene.glsl
+    string traceDefines() const {
+        stringstream ss;
+        ss << fixed << setprecision(4);
+        ss << "#define THROAT_RADIUS " << throatRadius << "\n";
+        ss << "#define TRACE_GROUP_SIZE " << traceGroupSize << "\n";
+        ss << "#define STARFIELD_MODE " << (int)starfieldMode << "\n";
+        ss << "#define DEBUG_VIEW " << (int)debugView << "\n";
+        if (lensingMode != LENSING_APPROXIMATE) {
+            ss << "#define GEODESIC_LUT " << (lensingMode == LENSING_GEODESIC_LUT ? 1 : 0) << "\n";
+        }
+        return ss.str();
+    }
+
+    // the trace program for the current settings, 0 while that variant doesn't compile
+    GLuint traceProgram() {
+        string path = lensingMode == LENSING_APPROXIMATE ? "wormhole.comp" : "geodesic.comp";
+        string defines = traceDefines();
+        ShaderVariant& variant = traceVariants[path + "\n" + defines];
+        if (variant.files.empty()) {
+            variant.path = path;
+            variant.defines = defines;
+            variant.program = createComputeProgram(path, defines, &variant.files);
+            variant.writeTime = newestWriteTime(variant.files);
+        }
+        return variant.program;
+    }
+
+    // rebuilds the trace variants whose shader or includes were saved since they were
+    // compiled. one that no longer compiles keeps its last good program
+    void reloadChangedShaders() {
+        for (auto& entry : traceVariants) {
+            ShaderVariant& variant = entry.second;
+            filesystem::file_time_type writeTime = newestWriteTime(variant.files);
+            if (writeTime == variant.writeTime) {
+                continue;
+            }
+            variant.writeTime = writeTime;
+            vector<string> files;
+            GLuint program = createComputeProgram(variant.path, variant.defines, &files);
+            if (!files.empty()) {
+                variant.files = files; // the includes may have changed
+            }
+            if (program) {
+                glDeleteProgram(variant.program);
+                variant.program = program;
+                cout << "reloaded " << variant.path << "\n";
+                historyValid = false;
+                stillFrames = 0;
+            }
+        }
+    }
+
+    void initCompute() {
+        traceProgram(); // the startup variant, the others compile when they're first used
+        quantizeShaderProgram = createComputeProgram("quantize.comp");
+        halfShaderProgram = createComputeProgram("quantize.comp", "#define QUANTIZE_HALF 1\n");
+        starfieldBakeProgram = createComputeProgram("starfield_bake.comp");
+        animateProgram = createComputeProgram("animate.comp");
+        upsampleProgram = createComputeProgram("upsample.comp");
+        historyValidLoc = glGetUniformLocation(upsampleProgram, "historyValid");
+        accumulateProgram = createComputeProgram("accumulate.comp");
+        sampleIndexLoc = glGetUniformLocation(accumulateProgram, "sampleIndex");
+        animatePassLoc = glGetUniformLocation(animateProgram, "animatePass");
+        refitBeginLoc = glGetUniformLocation(animateProgram, "refitBegin");
+        refitEndLoc = glGetUniformLocation(animateProgram, "refitEnd");
 
         glGenBuffers(1, &cameraUBO);
         glBindBuffer(GL_UNIFORM_BUFFER, cameraUBO);
         glBufferData(GL_UNIFORM_BUFFER, sizeof(Camera), NULL, GL_DYNAMIC_DRAW);
         glBindBufferBase(GL_UNIFORM_BUFFER, 0, cameraUBO);
 
+        glGenBuffers(1, &frameUBO);
+        glBindBuffer(GL_UNIFORM_BUFFER, frameUBO);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameData), NULL, GL_DYNAMIC_DRAW);
+        glBindBufferBase(GL_UNIFORM_BUFFER, 1, frameUBO);
+
+        glGenBuffers(1, &prevCameraUBO);
+        glBindBuffer(GL_UNIFORM_BUFFER, prevCameraUBO);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(Camera), NULL, GL_DYNAMIC_DRAW);
+        glBindBufferBase(GL_UNIFORM_BUFFER, 2, prevCameraUBO);
+
         glGenBuffers(1, &spheresSSBO);
+        glGenBuffers(1, &sourceSpheresSSBO);
+        glGenBuffers(1, &orbitsSSBO);
+        glGenBuffers(1, &bvhNodesSSBO);
+        glGenBuffers(1, &refitOrderSSBO);
         glGenBuffers(1, &starsSSBO);
+        glGenBuffers(1, &starCellsSSBO);
+        glGenBuffers(1, &meshTrianglesSSBO);
+        glGenBuffers(1, &meshVerticesSSBO);
+        glGenBuffers(1, &bvhPrimsSSBO);
+
+        glGenBuffers(PROFILE_RING_SIZE, costSSBOs);
+        for (GLuint b : costSSBOs) {
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, b);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, 8 * sizeof(GLuint), NULL, GL_DYNAMIC_READ);
+        }
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 12, costSSBOs[0]);
+
+        glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+        glGenTextures(1, &starfieldCubemap);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, starfieldCubemap);
+        glTexStorage2D(GL_TEXTURE_CUBE_MAP, 1, GL_R11F_G11F_B10F, STARFIELD_CUBEMAP_SIZE, STARFIELD_CUBEMAP_SIZE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    }
+
+    void resolveSuns() {
+        sunIndex[0] = sunIndex[1] = -1;
+        for (size_t i = 0; i < spheres.size(); ++i) {
+            const Sphere& s = spheres[i];
+            if (s.properties.x > 0.5f) { // isEmissive
+                sunIndex[s.properties.y > 1.5f ? 1 : 0] = (int)i;
+            }
+        }
     }
 
     void uploadSceneData() {
+        resolveSuns();
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, sourceSpheresSSBO);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, spheres.size() * sizeof(Sphere), spheres.data(), GL_STATIC_DRAW);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, sourceSpheresSSBO);
+
         glBindBuffer(GL_SHADER_STORAGE_BUFFER, spheresSSBO);
-        glBufferData(GL_SHADER_STORAGE_BUFFER, spheres.size() * sizeof(Sphere), spheres.data(), GL_DYNAMIC_DRAW);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, spheres.size() * sizeof(Sphere), spheres.data(), GL_DYNAMIC_COPY);
         glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, spheresSSBO);
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, orbitsSSBO);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, orbits.size() * sizeof(Orbit), orbits.data(), GL_STATIC_DRAW);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, orbitsSSBO);
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, meshTrianglesSSBO);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, mesh.triangles.size() * sizeof(MeshTriangle), mesh.triangles.data(), GL_STATIC_DRAW);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, meshTrianglesSSBO);
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, meshVerticesSSBO);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, mesh.vertices.size() * sizeof(MeshVertex), mesh.vertices.data(), GL_STATIC_DRAW);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, meshVerticesSSBO);
+
+        bvh.build();
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, bvhNodesSSBO);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, bvh.nodes.size() * sizeof(BVHNode), bvh.nodes.data(), GL_DYNAMIC_COPY);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, bvhNodesSSBO);
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, refitOrderSSBO);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, bvh.refitOrder.size() * sizeof(GLint), bvh.refitOrder.data(), GL_STATIC_DRAW);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 11, refitOrderSSBO);
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, bvhPrimsSSBO);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, bvh.primRefs.size() * sizeof(GLuint), bvh.primRefs.data(), GL_STATIC_DRAW);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, bvhPrimsSSBO);
         
         glBindBuffer(GL_SHADER_STORAGE_BUFFER, starsSSBO);
         glBufferData(GL_SHADER_STORAGE_BUFFER, stars.size() * sizeof(Star), stars.data(), GL_STATIC_DRAW);
         glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, starsSSBO);
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, starCellsSSBO);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, starCells.size() * sizeof(GLuint), starCells.data(), GL_STATIC_DRAW);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, starCellsSSBO);
+
+        bakeStarfield();
+        beginFrame(0.0f);
+        animate();
     }
 
-    void updateSpheresSSBO() {
-        glBindBuffer(GL_SHADER_STORAGE_BUFFER, spheresSSBO);
-        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, spheres.size() * sizeof(Sphere), spheres.data());
+    // splats every star into a fixed-point accumulation buffer, then resolves it into
+    // the cubemap. only needs to run again when the star catalog changes.
+    void bakeStarfield() {
+        const int n = STARFIELD_CUBEMAP_SIZE;
+        GLuint accumSSBO;
+        glGenBuffers(1, &accumSSBO);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, accumSSBO);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)6 * n * n * 3 * sizeof(GLuint), NULL, GL_STREAM_COPY);
+        GLuint zero = 0;
+        glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, accumSSBO);
+
+        glUseProgram(starfieldBakeProgram);
+        glUniform1i(glGetUniformLocation(starfieldBakeProgram, "numStars"), (GLint)stars.size());
+        glUniform1i(glGetUniformLocation(starfieldBakeProgram, "cubeSize"), n);
+        glBindImageTexture(0, starfieldCubemap, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_R11F_G11F_B10F);
+
+        glUniform1i(glGetUniformLocation(starfieldBakeProgram, "bakePass"), 0);
+        glDispatchCompute(((GLuint)stars.size() + 63) / 64, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        glUniform1i(glGetUniformLocation(starfieldBakeProgram, "bakePass"), 1);
+        glDispatchCompute((n + 63) / 64, n, 6);
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+        glDeleteBuffers(1, &accumSSBO);
         glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
     }
+
+    // moves every sphere to its orbital position at the frame's time and refits the
+    // bvh, all on the gpu, so the cpu cost doesn't depend on the number of bodies
+    void animate() {
+        profiler.begin(PROFILE_ANIMATE);
+        glUseProgram(animateProgram);
+
+        glUniform1i(animatePassLoc, 0);
+        glDispatchCompute(((GLuint)spheres.size() + 63) / 64, 1, 1);
+
+        glUniform1i(animatePassLoc, 1);
+        for (size_t level = 0; level + 1 < bvh.refitLevels.size(); ++level) {
+            int begin = bvh.refitLevels[level];
+            int end = bvh.refitLevels[level + 1];
+            glUniform1i(refitBeginLoc, begin);
+            glUniform1i(refitEndLoc, end);
+            glDispatchCompute((GLuint)(end - begin + 63) / 64, 1, 1);
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        }
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        profiler.end(PROFILE_ANIMATE);
+    }
     
     void initQuad() {
         float quadVertices[] = {
@@ -345,57 +1674,417 @@ struct Engine {
         glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2 * sizeof(float)));
         glEnableVertexAttribArray(1);
         
-        glGenTextures(1, &texture);
-        glBindTexture(GL_TEXTURE_2D, texture);
+        GLuint floatTargets[4];
+        glGenTextures(4, floatTargets);
+        texture = floatTargets[0];
+        historyTexture = floatTargets[1];
+        lowResTexture = floatTargets[2];
+        accumTexture = floatTargets[3];
+        for (GLuint t : floatTargets) {
+            glBindTexture(GL_TEXTURE_2D, t);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+
+        glGenTextures(1, &quantizedTexture);
+        glGenTextures(1, &halfTexture);
+        for (GLuint t : {quantizedTexture, halfTexture}) {
+            glBindTexture(GL_TEXTURE_2D, t);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        }
+
+        allocateTargets();
+    }
+
+    // the low res target is allocated at full size so render scale changes never reallocate;
+    // only its renderExtent corner is traced
+    void allocateTargets() {
+        for (GLuint t : {texture, historyTexture, lowResTexture, accumTexture}) {
+            glBindTexture(GL_TEXTURE_2D, t);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+        }
+        historyValid = false;
+        stillFrames = 0;
+        glBindTexture(GL_TEXTURE_2D, quantizedTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glBindTexture(GL_TEXTURE_2D, halfTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_HALF_FLOAT, NULL);
+    }
+
+    // reallocates the render targets for a new resolution. the readback ring follows
+    // lazily in beginReadback, so this must not be called with readbacks in flight
+    void resize(int w, int h) {
+        if (w <= 0 || h <= 0 || (w == width && h == height)) {
+            return; // minimized, or nothing changed
+        }
+        width = w;
+        height = h;
+        pixels.resize((size_t)width * height * 3);
+        allocateTargets();
+        cout << "resolution " << width << "x" << height << "\n";
+    }
+
+    int groupsX() const { return (width + 7) / 8; }
+    int groupsY() const { return (height + 7) / 8; }
+    
+    void initReadback() {
+        glGenBuffers(READBACK_RING_SIZE, readbackPBOs);
+        for (int i = 0; i < READBACK_RING_SIZE; ++i) {
+            readbackFences[i] = nullptr;
+        }
+        reallocReadback();
+    }
+
+    size_t readbackFrameSize() const {
+        if (hdrReadback) return (size_t)width * height * 4 * sizeof(uint16_t);
+        return (size_t)width * height * (gpuQuantize ? 4 : 4 * sizeof(float));
+    }
+
+    void reallocReadback() {
+        readbackSize = readbackFrameSize();
+        for (int i = 0; i < READBACK_RING_SIZE; ++i) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackPBOs[i]);
+            glBufferData(GL_PIXEL_PACK_BUFFER, readbackSize, NULL, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    // clamps and flips the float output into the rgba8 texture on the gpu, or only flips
+    // it into the rgba16f one for hdr output
+    void quantizePixels(GLuint program, GLuint target, GLenum format) {
+        glUseProgram(program);
+        glBindImageTexture(0, texture, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+        glBindImageTexture(1, target, 0, GL_FALSE, 0, GL_WRITE_ONLY, format);
+        glDispatchCompute(groupsX(), groupsY(), 1);
+        glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+    }
+
+    // queues a copy of the output texture into a ring pbo and returns without waiting.
+    // the transfer lands asynchronously while the next frames are dispatched.
+    void beginReadback(int slot) {
+        if (readbackSize != readbackFrameSize()) {
+            reallocReadback();
+        }
+        profiler.begin(PROFILE_READBACK);
+
+        glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackPBOs[slot]);
+        if (hdrReadback) {
+            quantizePixels(halfShaderProgram, halfTexture, GL_RGBA16F);
+            glPixelStorei(GL_PACK_ALIGNMENT, 4);
+            glBindTexture(GL_TEXTURE_2D, halfTexture);
+            glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_HALF_FLOAT, (void*)0);
+        } else if (gpuQuantize) {
+            quantizePixels(quantizeShaderProgram, quantizedTexture, GL_RGBA8);
+            glPixelStorei(GL_PACK_ALIGNMENT, 4);
+            glBindTexture(GL_TEXTURE_2D, quantizedTexture);
+            glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+        } else {
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, (void*)0);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        profiler.end(PROFILE_READBACK);
+        readbackFences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    // blocks until the slot's transfer has completed, then copies it out of the pbo
+    void finishReadback(int slot, vector<unsigned char>& out) {
+        out.resize(readbackSize);
+        copyReadback(slot, out.data());
+    }
+
+    void finishReadback(int slot, vector<uint16_t>& out) {
+        out.resize(readbackSize / sizeof(uint16_t));
+        copyReadback(slot, out.data());
+    }
+
+    void copyReadback(int slot, void* out) {
+        profiler.begin(PROFILE_READBACK);
+        GLsync fence = readbackFences[slot];
+        if (fence) {
+            while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED) {}
+            glDeleteSync(fence);
+            readbackFences[slot] = nullptr;
+        }
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackPBOs[slot]);
+        const void* src = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, readbackSize, GL_MAP_READ_BIT);
+        if (src) {
+            memcpy(out, src, readbackSize);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        profiler.end(PROFILE_READBACK);
+    }
+    
+    static float halton(unsigned int i, unsigned int base) {
+        float f = 1.0f, r = 0.0f;
+        for (; i > 0; i /= base) {
+            f /= (float)base;
+            r += f * (float)(i % base);
+        }
+        return r;
+    }
+
+    // nudges the render scale towards the target frame time. the traced pixel count
+    // goes with the square of the scale, hence the square root of the time ratio
+    void updateRenderScale(float frameTime) {
+        if (!dynamicResolution || frameTime <= 0.0f) {
+            return;
+        }
+        smoothedFrameTime = smoothedFrameTime > 0.0f ? mix(smoothedFrameTime, frameTime, 0.1f) : frameTime;
+        scaleTimer += frameTime;
+        if (scaleTimer < RENDER_SCALE_INTERVAL) {
+            return;
+        }
+        scaleTimer = 0.0f;
+
+        float ratio = targetFrameTime / smoothedFrameTime;
+        if (ratio > 0.95f && ratio < 1.1f) {
+            return; // close enough, don't chase noise
+        }
+        renderScale = glm::clamp(renderScale * glm::clamp(sqrt(ratio), 0.85f, 1.1f), RENDER_SCALE_MIN, 1.0f);
+    }
+
+    // counts how long the view has been unchanged, so accumulation restarts on its own
+    // as soon as the camera, universe or scene time moves
+    void updateStillFrames(float time) {
+        bool still = accumulation && stillFrames > 0 && time == accumTime && currentUniverse == accumUniverse &&
+                     lensingMode == accumLensing && debugView == accumDebugView &&
+                     view->position == accumCamera.position && view->target == accumCamera.target &&
+                     view->up == accumCamera.up && view->fov == accumCamera.fov;
+        stillFrames = still ? std::min(stillFrames + 1, ACCUM_MAX_SAMPLES + 2) : 1;
+        accumCamera = *view;
+        accumTime = time;
+        accumUniverse = currentUniverse;
+        accumLensing = lensingMode;
+        accumDebugView = debugView;
+    }
+
+    // index of this frame's sample in the accumulation, -1 when it isn't accumulating.
+    // with dynamic resolution the first frame of a new view goes through the upsampler
+    int accumSample() const {
+        if (!accumulation) {
+            return -1;
+        }
+        return dynamicResolution ? stillFrames - 2 : stillFrames - 1;
+    }
+
+    bool upsampling() const {
+        return dynamicResolution && accumSample() < 0;
+    }
+
+    // writes every per-frame scalar the shaders need in a single ubo update
+    void beginFrame(float time) {
+        profiler.begin(PROFILE_UPLOAD);
+        updateStillFrames(time);
+
+        FrameData frame = {};
+        frame.sunPosU1 = vec3(0, 5000, -6000);
+        frame.sunColorU1 = vec3(1.0f, 0.9f, 0.7f);
+        frame.sunPosU2 = vec3(0, -7000, 8000);
+        frame.sunColorU2 = vec3(0.7f, 0.8f, 1.0f);
+        if (sunIndex[0] >= 0) {
+            frame.sunPosU1 = vec3(spheres[sunIndex[0]].centerAndRadius);
+            frame.sunColorU1 = vec3(spheres[sunIndex[0]].color);
+        }
+        if (sunIndex[1] >= 0) {
+            frame.sunPosU2 = vec3(spheres[sunIndex[1]].centerAndRadius);
+            frame.sunColorU2 = vec3(spheres[sunIndex[1]].color);
+        }
+
+        frame.time = time;
+        frame.currentUniverse = currentUniverse;
+        frame.numSpheres = (int)spheres.size();
+        frame.numStars = (int)stars.size();
+        frame.numTriangles = (int)mesh.triangles.size();
+        frame.meshBoundsMin = mesh.boundsMin;
+        frame.meshQuantizeScale = mesh.quantizeScale();
+        frame.starfieldMode = starfieldMode;
+        frame.bvhRoots = ivec2(bvh.roots[0], bvh.roots[1]);
+        frame.starCellGrid = STAR_CELL_GRID;
+        frame.geodesicTolerance = geodesicTolerance;
+        frame.geodesicLut = lensingMode == LENSING_GEODESIC_LUT ? 1 : 0;
+        frame.lutMaxRadius = DEFLECTION_LUT_RADIUS;
+        frame.debugView = debugView;
+
+        renderExtent = ivec2(width, height);
+        int sample = accumSample();
+        if (upsampling()) {
+            renderExtent = glm::max(ivec2(1), ivec2(vec2(width, height) * renderScale + 0.5f));
+            frame.jitter = vec2(halton(frameIndex % 8 + 1, 2), halton(frameIndex % 8 + 1, 3)) - 0.5f;
+        } else if (sample > 0) {
+            frame.jitter = vec2(halton(sample, 2), halton(sample, 3)) - 0.5f; // sample 0 stays centered
+        }
+        frame.renderExtent = renderExtent;
+        frameIndex++;
+
+        glBindBuffer(GL_UNIFORM_BUFFER, frameUBO);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameData), &frame);
+        profiler.end(PROFILE_UPLOAD);
+    }
+
+    // loads the deflection table from its cache, or integrates it once, into an
+    // angles x radii texture sampled by geodesic.comp
+    void createDeflectionLut() {
+        DeflectionTable table;
+        auto start = chrono::steady_clock::now();
+        bool cached = table.loadOrBuild("deflection_lut.bin", DEFLECTION_LUT_RADIUS, geodesicTolerance);
+        float seconds = chrono::duration<float>(chrono::steady_clock::now() - start).count();
+        cout << (cached ? "loaded deflection table in " : "integrated deflection table in ") << seconds << " s\n";
+
+        glGenTextures(1, &deflectionLut);
+        glBindTexture(GL_TEXTURE_2D, deflectionLut);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, table.angles, table.radii, 0, GL_RGBA, GL_FLOAT, table.texels.data());
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, WIDTH, HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     }
-    
+
     void computePixels() {
-        glUseProgram(computeShaderProgram);
+        bool counting = debugView != DEBUG_VIEW_NONE;
+        if (counting) {
+            costSlot = (costSlot + 1) % PROFILE_RING_SIZE;
+            readCostTotals(costSlot);
+        }
+        profiler.begin(PROFILE_TRACE);
+        if (counting) {
+            GLuint zero = 0;
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 12, costSSBOs[costSlot]);
+            glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+        }
+        dispatchTrace();
+        if (counting) {
+            costFences[costSlot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        }
+        profiler.end(PROFILE_TRACE);
+    }
+
+    // per pixel averages from the cost buffer of slot, written PROFILE_RING_SIZE traces
+    // ago. when that trace still hasn't finished its totals are skipped, not waited for
+    void readCostTotals(int slot) {
+        GLsync& fence = costFences[slot];
+        if (!fence) {
+            return;
+        }
+        GLenum state = glClientWaitSync(fence, 0, 0);
+        glDeleteSync(fence);
+        fence = nullptr;
+        if (state != GL_ALREADY_SIGNALED && state != GL_CONDITION_SATISFIED) {
+            return;
+        }
+        GLuint totals[8];
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, costSSBOs[slot]);
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(totals), totals);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        auto total = [&](int counter) { return (double)totals[counter * 2] + (double)totals[counter * 2 + 1] * 4294967296.0; };
+        double pixels = total(3);
+        if (pixels > 0.0) { // nothing was traced when the accumulation has converged
+            for (int c = 0; c < 3; ++c) {
+                costPerPixel[c] = total(c) / pixels;
+            }
+        }
+    }
+
+    void dispatchTrace() {
+        if (lensingMode == LENSING_GEODESIC_LUT && !deflectionLut) {
+            createDeflectionLut();
+        }
+        GLuint program = traceProgram();
+        if (!program) {
+            return;
+        }
+        glUseProgram(program);
 
         glBindBuffer(GL_UNIFORM_BUFFER, cameraUBO);
-        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(Camera), &camera);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(Camera), view);
         
-        vec3 sunPosU1 = vec3(0, 5000, -6000); 
-        vec3 sunColorU1 = vec3(1.0f, 0.9f, 0.7f);
-        vec3 sunPosU2 = vec3(0, -7000, 8000);
-        vec3 sunColorU2 = vec3(0.7f, 0.8f, 1.0f);
+        glBindImageTexture(0, texture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, starfieldCubemap);
+        glActiveTexture(GL_TEXTURE4);
+        glBindTexture(GL_TEXTURE_2D, deflectionLut);
+        glActiveTexture(GL_TEXTURE0);
+
+        int sample = accumSample();
+        if (sample >= ACCUM_MAX_SAMPLES) {
+            return; // converged, texture already holds the final image
+        }
+        int g = traceGroupSize;
+        if (!upsampling() && sample < 0) {
+            glDispatchCompute((width + g - 1) / g, (height + g - 1) / g, 1);
+            glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+            return;
+        }
 
-        for(const auto& s : spheres) {
-            if (s.properties.x > 0.5f) { // isEmissive
-                if (s.properties.y > 1.5f) { // universeID == 2
-                    sunPosU2 = vec3(s.centerAndRadius);
-                    sunColorU2 = vec3(s.color);
-                } else { // universeID == 1
-                    sunPosU1 = vec3(s.centerAndRadius);
-                    sunColorU1 = vec3(s.color);
-                }
-            }
+        glBindImageTexture(0, lowResTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+        glDispatchCompute((renderExtent.x + g - 1) / g, (renderExtent.y + g - 1) / g, 1);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+        if (upsampling()) {
+            upsample();
+        } else {
+            accumulateSample(sample);
         }
+    }
+
+    // adds the jittered sample just traced into lowResTexture to the running sum and
+    // writes the average to the output
+    void accumulateSample(int sample) {
+        glUseProgram(accumulateProgram);
+        glUniform1i(sampleIndexLoc, sample);
+        glBindImageTexture(0, lowResTexture, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+        glBindImageTexture(1, accumTexture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+        glBindImageTexture(2, texture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+        glDispatchCompute(groupsX(), groupsY(), 1);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+    }
+
+    // reconstructs the full resolution frame from the low res trace and last frame's
+    // output, reprojected through the previous camera using the hit distance in alpha
+    void upsample() {
+        if (historyUniverse != currentUniverse) {
+            historyValid = false; // the whole scene changed, nothing to reproject
+            historyUniverse = currentUniverse;
+        }
+        std::swap(texture, historyTexture);
+
+        glUseProgram(upsampleProgram);
+        glBindBuffer(GL_UNIFORM_BUFFER, prevCameraUBO);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(Camera), historyValid ? &prevCamera : view);
+        glUniform1i(historyValidLoc, historyValid ? 1 : 0);
 
-        glUniform1i(glGetUniformLocation(computeShaderProgram, "currentUniverse"), currentUniverse);
-        glUniform1i(glGetUniformLocation(computeShaderProgram, "numSpheres"), (GLint)spheres.size());
-        glUniform1i(glGetUniformLocation(computeShaderProgram, "numStars"), (GLint)stars.size());
-        glUniform3fv(glGetUniformLocation(computeShaderProgram, "sunPosU1"), 1, value_ptr(sunPosU1));
-        glUniform3fv(glGetUniformLocation(computeShaderProgram, "sunPosU2"), 1, value_ptr(sunPosU2));
-        glUniform3fv(glGetUniformLocation(computeShaderProgram, "sunColorU1"), 1, value_ptr(sunColorU1));
-        glUniform3fv(glGetUniformLocation(computeShaderProgram, "sunColorU2"), 1, value_ptr(sunColorU2));
-        glUniform1f(glGetUniformLocation(computeShaderProgram, "time"), (float)glfwGetTime());
-        
         glBindImageTexture(0, texture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, lowResTexture);
+        glActiveTexture(GL_TEXTURE3);
+        glBindTexture(GL_TEXTURE_2D, historyTexture);
+        glActiveTexture(GL_TEXTURE0);
+
+        glDispatchCompute(groupsX(), groupsY(), 1);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
 
-        glDispatchCompute(WIDTH / 8, HEIGHT / 8, 1);
-        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        prevCamera = *view;
+        historyValid = true;
     }
 
     void drawPixels() {
+        profiler.begin(PROFILE_BLIT);
         glClear(GL_COLOR_BUFFER_BIT);
         glUseProgram(shaderProgram);
         glBindTexture(GL_TEXTURE_2D, texture);
         glBindVertexArray(quadVAO);
         glDrawArrays(GL_TRIANGLES, 0, 6);
+        if (profiler.showOverlay) {
+            int fbWidth, fbHeight;
+            glfwGetFramebufferSize(window, &fbWidth, &fbHeight);
+            profiler.drawOverlay(fbWidth, fbHeight, targetFrameTime * 1000.0);
+        }
+        profiler.end(PROFILE_BLIT); // before the swap, which waits for vsync
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
@@ -410,9 +2099,43 @@ struct Engine {
 // callbacks and helpers
 //------------------------------------------------------------------------------
 void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+    unsigned moveKey = 0;
+    switch (key) {
+    case GLFW_KEY_W: moveKey = MOVE_FORWARD; break;
+    case GLFW_KEY_S: moveKey = MOVE_BACK; break;
+    case GLFW_KEY_A: moveKey = MOVE_LEFT; break;
+    case GLFW_KEY_D: moveKey = MOVE_RIGHT; break;
+    case GLFW_KEY_SPACE: moveKey = MOVE_DOWN; break;
+    case GLFW_KEY_LEFT_SHIFT:
+    case GLFW_KEY_RIGHT_SHIFT: moveKey = MOVE_UP; break;
+    }
+    if (moveKey && action != GLFW_REPEAT) {
+        lock_guard<mutex> lock(inputMutex);
+        input.heldKeys = action == GLFW_PRESS ? input.heldKeys | moveKey : input.heldKeys & ~moveKey;
+    }
     if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS) {
         glfwSetWindowShouldClose(window, true);
     }
+    if (key == GLFW_KEY_P && action == GLFW_PRESS) {
+        timePaused = !timePaused;
+        cout << (timePaused ? "animation paused\n" : "animation resumed\n");
+    }
+    if (key == GLFW_KEY_G && action == GLFW_PRESS) {
+        static const char* names[] = {"approximate lensing\n", "geodesic lensing\n", "geodesic lensing from the deflection table\n"};
+        lensingMode = (LensingMode)((lensingMode + 1) % 3);
+        cout << names[lensingMode];
+    }
+    if (key == GLFW_KEY_H && action == GLFW_PRESS) {
+        debugView = (DebugView)((debugView + 1) % 4);
+        cout << "debug view: " << DEBUG_VIEW_NAMES[debugView] << "\n";
+    }
+    if (key == GLFW_KEY_O && action == GLFW_PRESS) {
+        profilerOverlay = !profilerOverlay;
+        if (profilerOverlay) {
+            cout << "profiler overlay: gpu animate red, upload yellow, trace green, blit blue, readback purple; "
+                    "white is the cpu frame time, the gray line the target\n";
+        }
+    }
     if (key == GLFW_KEY_U && action == GLFW_PRESS) {
         currentUniverse = (currentUniverse == 1) ? 2 : 1;
         cout << "switched to universe " << currentUniverse << "\n";
@@ -422,66 +2145,53 @@ void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
 void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods) {
     if (button == GLFW_MOUSE_BUTTON_LEFT) {
         if (action == GLFW_PRESS) {
-            camera.dragging = true;
-            camera.panning = (mods & GLFW_MOD_SHIFT);
+            mouseDrag.dragging = true;
+            mouseDrag.panning = (mods & GLFW_MOD_SHIFT);
             double x, y;
             glfwGetCursorPos(window, &x, &y);
-            camera.lastX = (float)x;
-            camera.lastY = (float)y;
+            mouseDrag.lastX = (float)x;
+            mouseDrag.lastY = (float)y;
         } else {
-            camera.dragging = false;
-            camera.panning = false;
+            mouseDrag.dragging = false;
+            mouseDrag.panning = false;
         }
     }
 }
 
 void cursorPosCallback(GLFWwindow* window, double x, double y) {
-    if (camera.dragging) {
-        float dx = (float)x - camera.lastX;
-        float dy = (float)y - camera.lastY;
-        if (camera.panning) {
-            camera.pan(dx, dy);
-        } else {
-            camera.orbit(dx, dy);
+    if (mouseDrag.dragging) {
+        vec2 delta((float)x - mouseDrag.lastX, (float)y - mouseDrag.lastY);
+        {
+            lock_guard<mutex> lock(inputMutex);
+            (mouseDrag.panning ? input.pan : input.orbit) += delta;
         }
-        camera.lastX = (float)x;
-        camera.lastY = (float)y;
+        mouseDrag.lastX = (float)x;
+        mouseDrag.lastY = (float)y;
     }
 }
 
 void scrollCallback(GLFWwindow* window, double xoffset, double yoffset) {
-    camera.zoom((float)yoffset);
+    lock_guard<mutex> lock(inputMutex);
+    input.zoom += (float)yoffset;
 }
 
-struct Keyframe {
-    float timeSec;
-    float posAzimuthDeg;
-    float posElevationDeg;
-    float posRadius;
-    vec3 target;
-};
+// the render targets are resized from the main loop, since callbacks can't reach the engine
+ivec2 framebufferSize(0);
+bool framebufferResized = false;
 
-static bool loadCameraPath(const string& pathFile, vector<Keyframe>& out) {
-    ifstream in(pathFile);
-    if (!in.is_open()) return false;
-    string line;
-    while (getline(in, line)) {
-        if (line.empty() || line[0] == '#') continue;
-        istringstream ss(line);
-        Keyframe k{};
-        if (!(ss >> k.timeSec >> k.posAzimuthDeg >> k.posElevationDeg >> k.posRadius >> k.target.x >> k.target.y >> k.target.z)) continue;
-        out.push_back(k);
-    }
-    return !out.empty();
+void framebufferSizeCallback(GLFWwindow* window, int w, int h) {
+    glViewport(0, 0, w, h);
+    framebufferSize = ivec2(w, h);
+    framebufferResized = true;
 }
 
-static void setCamera(const vec3& pos, const vec3& target) {
-    camera.position = pos;
-    camera.target = target;
+static void setCamera(const vec3& pos, const vec3& target, Camera& c = camera) {
+    c.position = pos;
+    c.target = target;
     vec3 dir = target - pos;
-    camera.radius = length(dir);
-    camera.azimuth = atan2(dir.z, dir.x);
-    camera.elevation = acos(dir.y / camera.radius);
+    c.radius = length(dir);
+    c.azimuth = atan2(dir.z, dir.x);
+    c.elevation = acos(dir.y / c.radius);
 }
 
 static void writePPM(const string& filename, const vector<unsigned char>& buf, int w, int h) {
@@ -490,44 +2200,317 @@ static void writePPM(const string& filename, const vector<unsigned char>& buf, i
     out.write(reinterpret_cast<const char*>(buf.data()), static_cast<streamsize>(w*h*3));
 }
 
+//------------------------------------------------------------------------------
+// frame encoding
+//------------------------------------------------------------------------------
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#endif
+
+static bool ffmpegAvailable() {
+#ifdef _WIN32
+    return system("ffmpeg -version >nul 2>&1") == 0;
+#else
+    return system("ffmpeg -version >/dev/null 2>&1") == 0;
+#endif
+}
+
+// converts a bottom-up rgba float frame into top-down 8-bit rgb
+static void convertFrame(const float* rgba, unsigned char* rgb, int w, int h) {
+    for (int y = 0; y < h; ++y) {
+        const float* src = rgba + (size_t)y * w * 4;
+        unsigned char* dst = rgb + (size_t)(h - 1 - y) * w * 3;
+        for (int x = 0; x < w; ++x) {
+            dst[x * 3 + 0] = static_cast<unsigned char>(glm::clamp(src[x * 4 + 0], 0.0f, 1.0f) * 255);
+            dst[x * 3 + 1] = static_cast<unsigned char>(glm::clamp(src[x * 4 + 1], 0.0f, 1.0f) * 255);
+            dst[x * 3 + 2] = static_cast<unsigned char>(glm::clamp(src[x * 4 + 2], 0.0f, 1.0f) * 255);
+        }
+    }
+}
+
+// drops the alpha channel of an already quantized and flipped rgba8 frame
+static void stripAlpha(const unsigned char* rgba, unsigned char* rgb, size_t numPixels) {
+    for (size_t i = 0; i < numPixels; ++i) {
+        rgb[i * 3 + 0] = rgba[i * 4 + 0];
+        rgb[i * 3 + 1] = rgba[i * 4 + 1];
+        rgb[i * 3 + 2] = rgba[i * 4 + 2];
+    }
+}
+
+// producer/consumer stage between the render thread and the video file.
+// the render thread submits raw frames into a bounded queue, a worker pool converts
+// them, and a writer thread streams them in order into an ffmpeg child over stdin.
+// if ffmpeg isn't installed, the writer falls back to numbered ppm files instead.
+// frames arrive either as raw rgba32f texels or already quantized to rgba8 on the
+// gpu, in which case they go to ffmpeg as-is without any cpu conversion.
+struct FrameEncoder {
+    struct Frame {
+        int index;
+        vector<unsigned char> raw;
+        vector<unsigned char> out;
+    };
+
+    int width, height;
+    bool quantized = false;
+    FILE* pipe = nullptr;
+    string fallbackDir;
+    bool failed = false;
+
+    mutex mtx;
+    condition_variable canSubmit, hasWork, hasOutput;
+    deque<Frame> pending;
+    map<int, Frame> converted;
+    vector<vector<unsigned char>> freeBuffers;
+    int inFlight = 0;
+    int nextToWrite = 0;
+    bool closing = false;
+
+    vector<thread> workers;
+    thread writer;
+
+    void open(int w, int h, int fps, bool rgba8Input, const string& videoFile, const string& ppmDir) {
+        width = w;
+        height = h;
+        quantized = rgba8Input;
+
+        if (ffmpegAvailable()) {
+            string cmd = string("ffmpeg -loglevel error -y -f rawvideo -pix_fmt ") + (quantized ? "rgba" : "rgb24")
+                       + " -s " + to_string(w) + "x" + to_string(h)
+                       + " -r " + to_string(fps) + " -i - -c:v libx264 -pix_fmt yuv420p " + videoFile;
+#ifdef _WIN32
+            pipe = popen(cmd.c_str(), "wb");
+#else
+            signal(SIGPIPE, SIG_IGN);
+            pipe = popen(cmd.c_str(), "w");
+#endif
+        }
+        if (!pipe) {
+            cout << "ffmpeg not found, writing ppm frames to " << ppmDir << "/ instead.\n";
+            fallbackDir = ppmDir;
+            filesystem::create_directories(fallbackDir);
+        }
+
+        int numWorkers = std::max(1, std::min(4, (int)thread::hardware_concurrency() - 1));
+        for (int i = 0; i < numWorkers; ++i) {
+            workers.emplace_back([this] { convertLoop(); });
+        }
+        writer = thread([this] { writeLoop(); });
+    }
+
+    // returns a recycled frame buffer so the render thread doesn't allocate per frame
+    vector<unsigned char> acquireBuffer() {
+        lock_guard<mutex> lock(mtx);
+        if (freeBuffers.empty()) return vector<unsigned char>();
+        vector<unsigned char> buf = std::move(freeBuffers.back());
+        freeBuffers.pop_back();
+        return buf;
+    }
+
+    // hands a frame to the pool, blocking while ENCODER_QUEUE_SIZE frames are in flight
+    void submit(int index, vector<unsigned char>&& raw) {
+        unique_lock<mutex> lock(mtx);
+        canSubmit.wait(lock, [this] { return inFlight < ENCODER_QUEUE_SIZE; });
+        inFlight++;
+        pending.push_back({index, std::move(raw), {}});
+        hasWork.notify_one();
+    }
+
+    void convertLoop() {
+        for (;;) {
+            Frame frame;
+            {
+                unique_lock<mutex> lock(mtx);
+                hasWork.wait(lock, [this] { return closing || !pending.empty(); });
+                if (pending.empty()) return;
+                frame = std::move(pending.front());
+                pending.pop_front();
+            }
+
+            size_t numPixels = (size_t)width * height;
+            if (quantized && pipe) {
+                frame.out.swap(frame.raw);
+            } else if (quantized) {
+                frame.out.resize(numPixels * 3);
+                stripAlpha(frame.raw.data(), frame.out.data(), numPixels);
+            } else {
+                frame.out.resize(numPixels * 3);
+                convertFrame(reinterpret_cast<const float*>(frame.raw.data()), frame.out.data(), width, height);
+            }
+
+            lock_guard<mutex> lock(mtx);
+            if (!frame.raw.empty()) freeBuffers.push_back(std::move(frame.raw));
+            converted.emplace(frame.index, std::move(frame));
+            hasOutput.notify_one();
+        }
+    }
+
+    void writeLoop() {
+        for (;;) {
+            Frame frame;
+            {
+                unique_lock<mutex> lock(mtx);
+                hasOutput.wait(lock, [this] {
+                    return converted.count(nextToWrite) || (closing && inFlight == 0);
+                });
+                auto it = converted.find(nextToWrite);
+                if (it == converted.end()) return;
+                frame = std::move(it->second);
+                converted.erase(it);
+            }
+
+            if (pipe) {
+                size_t size = frame.out.size();
+                if (!failed && fwrite(frame.out.data(), 1, size, pipe) != size) {
+                    cerr << "\nerror: ffmpeg pipe closed unexpectedly\n";
+                    failed = true;
+                }
+            } else {
+                ostringstream name;
+                name << fallbackDir << "/frame_" << setw(5) << setfill('0') << frame.index << ".ppm";
+                writePPM(name.str(), frame.out, width, height);
+            }
+
+            lock_guard<mutex> lock(mtx);
+            if (quantized && pipe) freeBuffers.push_back(std::move(frame.out));
+            nextToWrite++;
+            inFlight--;
+            canSubmit.notify_one();
+            if (inFlight == 0) hasOutput.notify_all();
+        }
+    }
+
+    // drains every submitted frame and waits for ffmpeg to finish the file
+    bool close() {
+        {
+            lock_guard<mutex> lock(mtx);
+            closing = true;
+        }
+        hasWork.notify_all();
+        hasOutput.notify_all();
+        for (auto& w : workers) w.join();
+        writer.join();
+        workers.clear();
+
+        if (pipe) {
+            int ret = pclose(pipe);
+            pipe = nullptr;
+            return !failed && ret == 0;
+        }
+        return true;
+    }
+};
+
+//------------------------------------------------------------------------------
+// simulation thread
+//------------------------------------------------------------------------------
+// what the renderer needs from one simulation tick
+struct SimSnapshot {
+    Camera camera;
+    double time = 0.0; // animation time, stands still while paused
+    uint64_t tick = 0;
+};
+
+// interactive mode moves the camera and runs the animation clock in fixed SIM_TIMESTEP
+// ticks on a thread of its own, so movement speed doesn't depend on the frame rate and
+// a slow frame doesn't delay the next tick. the render thread draws the tick published
+// last, without waiting for it
+struct Simulation {
+    TripleBuffer<SimSnapshot> snapshots;
+    thread worker;
+    atomic<bool> running{false};
+    SimSnapshot state; // only touched by the worker while it runs
+
+    void start(const Camera& cam) {
+        state.camera = cam;
+        snapshots.reset(state);
+        running = true;
+        worker = thread([this] { run(); });
+    }
+
+    void stop() {
+        running = false;
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+    void run() {
+        auto step = chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(SIM_TIMESTEP));
+        auto maxLag = chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(SIM_MAX_LAG));
+        auto next = chrono::steady_clock::now();
+        while (running) {
+            tick((float)SIM_TIMESTEP);
+            snapshots.writeSlot() = state;
+            snapshots.publish();
+
+            next += step;
+            auto now = chrono::steady_clock::now();
+            if (now - next > maxLag) {
+                next = now; // the thread was starved, don't replay all the missed ticks at once
+            }
+            this_thread::sleep_until(next);
+        }
+    }
+
+    void tick(float dt) {
+        InputState in;
+        {
+            lock_guard<mutex> lock(inputMutex);
+            in = input;
+            input.orbit = input.pan = vec2(0.0f);
+            input.zoom = 0.0f;
+        }
+        Camera& cam = state.camera;
+        if (in.orbit != vec2(0.0f)) cam.orbit(in.orbit.x, in.orbit.y);
+        if (in.pan != vec2(0.0f)) cam.pan(in.pan.x, in.pan.y);
+        if (in.zoom != 0.0f) cam.zoom(in.zoom);
+        moveCamera(cam, in.heldKeys, dt);
+
+        if (!timePaused) {
+            state.time += dt;
+        }
+        state.tick++;
+    }
+};
+
 //------------------------------------------------------------------------------
 // main loop modes
 //------------------------------------------------------------------------------
-void runInteractiveMode(Engine& engine, const vector<Sphere>& initialSpheres) {
+void runInteractiveMode(Engine& engine) {
     cout << "starting interactive mode... (use -p for movie mode)\n";
     int frameCount = 0;
     double lastTime = glfwGetTime();
 
+    double lastFrameTime = lastTime;
+    double lastShaderPoll = lastTime;
+
+    Simulation sim;
+    sim.start(camera);
+
     while (!glfwWindowShouldClose(engine.window)) {
-        processInput(engine.window);
+        engine.profiler.showOverlay = profilerOverlay;
+        engine.profiler.nextFrame();
 
-        double time = glfwGetTime();
-        for (size_t i = 0; i < spheres.size(); ++i) {
-            bool isEmissive = initialSpheres[i].properties.x > 0.5f;
-            if (!isEmissive) {
-                vec3 initialPos = vec3(initialSpheres[i].centerAndRadius);
-                
-                int universeID = int(initialSpheres[i].properties.y);
-                vec3 rotation_axis = (universeID == 1) ? vec3(0.0, 1.0, 0.0) : vec3(0.1, 1.0, 0.0);
-                float orbit_radius = length(vec3(initialPos.x, 0.0, initialPos.z));
-                float speed_factor = 150.0f;
-                float angular_velocity = 10.0f / (orbit_radius + speed_factor);
-                float angle = (float)time * angular_velocity;
-                
-                if (universeID == 2) {
-                    angle = -angle;
-                }
+        double frameStart = glfwGetTime();
+        engine.updateRenderScale((float)(frameStart - lastFrameTime));
+        lastFrameTime = frameStart;
 
-                glm::mat4 rotation_matrix = glm::rotate(glm::mat4(1.0f), angle, normalize(rotation_axis));
-                vec3 new_pos = vec3(rotation_matrix * vec4(initialPos, 1.0f));
-                
-                spheres[i].centerAndRadius.x = new_pos.x;
-                spheres[i].centerAndRadius.y = new_pos.y;
-                spheres[i].centerAndRadius.z = new_pos.z;
-            }
+        if (framebufferResized) {
+            engine.resize(framebufferSize.x, framebufferSize.y);
+            framebufferResized = false;
+        }
+        if (frameStart - lastShaderPoll >= SHADER_POLL_INTERVAL) {
+            engine.reloadChangedShaders(); // edited trace shaders take effect without a restart
+            lastShaderPoll = frameStart;
         }
-        engine.updateSpheresSSBO();
 
+        // the events polled at the end of the last frame reach the simulation at its next
+        // tick, this frame shows the newest tick that's already done
+        const SimSnapshot& snapshot = sim.snapshots.latest();
+        camera = snapshot.camera;
+        engine.beginFrame((float)snapshot.time);
+        engine.animate();
         engine.render();
     
         frameCount++;
@@ -537,15 +2520,28 @@ void runInteractiveMode(Engine& engine, const vector<Sphere>& initialSpheres) {
             double fps = double(frameCount) / elapsedTime;
             stringstream ss;
             ss << "wormhole | " << spheres.size() << " objects | " << fixed << setprecision(1) << fps << " fps";
+            if (engine.accumSample() > 0) {
+                ss << " | " << std::min(engine.accumSample() + 1, ACCUM_MAX_SAMPLES) << " spp";
+            } else if (engine.dynamicResolution) {
+                ss << " | " << engine.renderExtent.x << "x" << engine.renderExtent.y;
+            }
+            if (profilerOverlay) {
+                ss << " | " << engine.profiler.summary(frameCount);
+            }
+            if (debugView != DEBUG_VIEW_NONE) {
+                ss << " | per px: " << engine.costPerPixel[0] << " steps, " << engine.costPerPixel[1] << " primitives, "
+                   << engine.costPerPixel[2] << " stars";
+            }
             glfwSetWindowTitle(engine.window, ss.str().c_str());
             
             frameCount = 0;
             lastTime = currentTime;
         }
     }
+    sim.stop();
 }
 
-void runMovieMode(Engine& engine) {
+void runMovieMode(Engine& engine, int samplesPerFrame, HdrFormat hdrFormat, int numDevices) {
     cout << "movie mode: rendering frames from camera_path.txt...\n";
     vector<Keyframe> keys;
     if (!loadCameraPath("camera_path.txt", keys)) {
@@ -557,81 +2553,296 @@ void runMovieMode(Engine& engine) {
     auto in_time_t = chrono::system_clock::to_time_t(now);
     stringstream ss;
     tm timeinfo;
+#ifdef _WIN32
     localtime_s(&timeinfo, &in_time_t);
+#else
+    localtime_r(&in_time_t, &timeinfo);
+#endif
     ss << "exports/run_" << put_time(&timeinfo, "%Y-%m-%d_%H-%M-%S");
     string exportDir = ss.str();
-    filesystem::create_directories(exportDir);
+    string videoFile = exportDir + ".mp4";
+    filesystem::create_directories("exports");
 
     float totalDuration = keys.back().timeSec;
     int totalFrames = static_cast<int>(totalDuration * MOVIE_FPS);
     
     cout << "rendering " << totalFrames << " frames for a " << totalDuration << "s video...\n";
 
-    size_t keyframe_idx = 0;
-    for (int i = 0; i < totalFrames; ++i) {
-        float currentTime = static_cast<float>(i) / MOVIE_FPS;
-
-        while (keyframe_idx + 1 < keys.size() && keys[keyframe_idx + 1].timeSec < currentTime) {
-            keyframe_idx++;
+    // hdr frames skip the encoder: half floats straight from the gpu go to exr files in
+    // exportDir or to one raw stream next to it
+    engine.hdrReadback = hdrFormat != HDR_NONE;
+    string hdrPath = hdrFormat == HDR_RAW ? exportDir + ".hraw" : exportDir;
+    FrameEncoder encoder;
+    HdrFrameWriter hdrWriter;
+    // the movie keeps the resolution it started with; resizing the window only rescales the preview
+    if (engine.hdrReadback) {
+        if (!hdrWriter.open(hdrFormat, hdrPath, engine.width, engine.height, MOVIE_FPS)) {
+            cout << "error: could not create " << hdrPath << "\n";
+            engine.hdrReadback = false;
+            return;
         }
+    } else {
+        encoder.open(engine.width, engine.height, MOVIE_FPS, engine.gpuQuantize, videoFile, exportDir);
+    }
 
-        const Keyframe& a = keys[keyframe_idx];
-        const Keyframe& b = keys[keyframe_idx + 1 < keys.size() ? keyframe_idx + 1 : keyframe_idx];
+    // with several gpus every device renders its own share of the frames, round robin,
+    // on a thread and context of its own. the extra engines are all set up here before
+    // any rendering starts, since uploading the scene also rebuilds the shared bvh.
+    // glew keeps one set of entry points for all of them, which holds as long as the
+    // gpus are driven by the same driver (or dispatched by libglvnd)
+    // whatever the trace builds lazily is built up front as well, or the devices would
+    // race on the program and deflection table caches
+    auto prepare = [](Engine& e) {
+        if (lensingMode == LENSING_GEODESIC_LUT && !e.deflectionLut) {
+            e.createDeflectionLut();
+        }
+        e.traceProgram();
+    };
+    vector<unique_ptr<Engine>> extraEngines;
+#ifdef WORMHOLE_EGL
+    for (int d = 1; d < numDevices; ++d) {
+        auto e = make_unique<Engine>(engine.width, engine.height, true, d);
+        e->gpuQuantize = engine.gpuQuantize;
+        e->hdrReadback = engine.hdrReadback;
+        e->accumulation = engine.accumulation;
+        e->starfieldMode = engine.starfieldMode;
+        e->uploadSceneData();
+        prepare(*e);
+        e->releaseCurrent();
+        extraEngines.push_back(std::move(e));
+    }
+    engine.makeCurrent();
+#else
+    (void)numDevices; // main already settled on one gpu
+#endif
+    prepare(engine);
+    int numEngines = 1 + (int)extraEngines.size();
+    if (numEngines > 1) {
+        cout << "spreading the frames over " << numEngines << " gpus\n";
+    }
 
-        float t = 0.0f;
-        if (b.timeSec > a.timeSec) {
-            t = (currentTime - a.timeSec) / (b.timeSec - a.timeSec);
+    // the writers see the frames in order, whichever device finished them first
+    mutex orderMutex;
+    condition_variable orderChanged;
+    int nextToSubmit = 0;
+    auto saveFrame = [&](Engine& e, int frame, int slot) {
+        vector<uint16_t> half_pixels;
+        vector<unsigned char> gpu_pixels;
+        if (e.hdrReadback) {
+            half_pixels = hdrWriter.acquireBuffer();
+            e.finishReadback(slot, half_pixels);
+        } else {
+            gpu_pixels = encoder.acquireBuffer();
+            e.finishReadback(slot, gpu_pixels);
         }
 
-        float az = glm::mix(a.posAzimuthDeg, b.posAzimuthDeg, t);
-        float el = glm::mix(a.posElevationDeg, b.posElevationDeg, t);
-        float rr = glm::mix(a.posRadius, b.posRadius, t);
-        vec3 interpolated_target = glm::mix(a.target, b.target, t);
+        unique_lock<mutex> lock(orderMutex);
+        orderChanged.wait(lock, [&] { return nextToSubmit == frame; });
+        if (e.hdrReadback) {
+            hdrWriter.submit(frame, std::move(half_pixels));
+        } else {
+            encoder.submit(frame, std::move(gpu_pixels));
+        }
+        nextToSubmit++;
+        orderChanged.notify_all();
+
+        cout << "rendered frame " << (frame + 1) << "/" << totalFrames << "\r" << flush;
+    };
+
+    // renders frames first, first + step, ... on e, whose context is current on this
+    // thread. they are read back READBACK_RING_SIZE - 1 frames behind the dispatch, so
+    // the gpu keeps computing while earlier frames are still transferring
+    auto renderFrames = [&](Engine& e, int first, int step) {
+        Camera view = camera;
+        e.view = &view;
+        vector<int> frames;
+        for (int f = first; f < totalFrames; f += step) {
+            frames.push_back(f);
+        }
+        int n = (int)frames.size();
+        for (int k = 0; k < n; ++k) {
+            e.profiler.nextFrame();
+            float currentTime = static_cast<float>(frames[k]) / MOVIE_FPS;
+
+            vec3 pos, target;
+            cameraPathAt(keys, currentTime, pos, target);
+            setCamera(pos, target, view);
+
+            // the same view and time traced samplesPerFrame times accumulates into one frame
+            for (int s = 0; s < samplesPerFrame; ++s) {
+                e.beginFrame(currentTime);
+                e.computePixels();
+            }
+            e.beginReadback(k % READBACK_RING_SIZE);
 
-        vec3 pos;
-        pos.x = interpolated_target.x + rr * sin(radians(el)) * cos(radians(az));
-        pos.y = interpolated_target.y + rr * cos(radians(el));
-        pos.z = interpolated_target.z + rr * sin(radians(el)) * sin(radians(az));
-        
-        setCamera(pos, interpolated_target);
+            int done = k - (READBACK_RING_SIZE - 1);
+            if (done >= 0) {
+                saveFrame(e, frames[done], done % READBACK_RING_SIZE);
+            }
+        }
+        for (int k = std::max(0, n - (READBACK_RING_SIZE - 1)); k < n; ++k) {
+            saveFrame(e, frames[k], k % READBACK_RING_SIZE);
+        }
+        e.view = &camera;
+    };
+
+    vector<thread> deviceThreads;
+#ifdef WORMHOLE_EGL
+    for (int d = 1; d < numEngines; ++d) {
+        deviceThreads.emplace_back([&, d] {
+            Engine& e = *extraEngines[d - 1];
+            e.makeCurrent();
+            renderFrames(e, d, numEngines);
+            e.releaseCurrent();
+        });
+    }
+#endif
+    renderFrames(engine, 0, numEngines);
+    for (auto& t : deviceThreads) {
+        t.join();
+    }
+#ifdef WORMHOLE_EGL
+    for (auto& e : extraEngines) {
+        e->destroyContext();
+    }
+#endif
+    cout << "\nrender complete, waiting for the encoder to finish...\n";
 
-        engine.computePixels();
-        ostringstream name;
-        name << exportDir << "/frame_" << setw(5) << setfill('0') << i << ".ppm";
-        string file = name.str();
+    if (engine.hdrReadback) {
+        engine.hdrReadback = false;
+        if (hdrWriter.close()) {
+            cout << totalFrames << " hdr frames written to " << hdrPath << (hdrFormat == HDR_EXR ? "/\n" : "\n");
+        }
+    } else if (!encoder.close()) {
+        cout << "error: ffmpeg failed to encode " << videoFile << "\n";
+    } else if (encoder.fallbackDir.empty()) {
+        cout << "successfully created video: " << videoFile << "\n";
+    } else {
+        cout << totalFrames << " frames written to " << exportDir << "/. to create the video, run:\n"
+             << "ffmpeg -r " << MOVIE_FPS << " -i " << exportDir << "/frame_%05d.ppm -c:v libx264 -pix_fmt yuv420p -y " << videoFile << "\n";
+    }
+}
 
-        vector<float> gpu_pixels(WIDTH * HEIGHT * 4);
-        glBindTexture(GL_TEXTURE_2D, engine.texture);
-        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, gpu_pixels.data());
+//------------------------------------------------------------------------------
+// benchmark
+//------------------------------------------------------------------------------
+// a torus of rings * segments * 2 triangles around center in universe 1, so the mesh
+// scene is the same everywhere without shipping a large obj
+static void buildBenchMesh(const vec3& center, float majorRadius, float minorRadius, int rings, int segments, Mesh& out) {
+    out = Mesh();
+    vec3 extent = vec3(majorRadius + minorRadius, minorRadius, majorRadius + minorRadius);
+    out.boundsMin = center - extent;
+    out.boundsMax = center + extent;
+    vec3 scale = 65535.0f / (out.boundsMax - out.boundsMin);
+    for (int i = 0; i < rings; ++i) {
+        float u = 2.0f * glm::pi<float>() * (float)i / (float)rings;
+        for (int j = 0; j < segments; ++j) {
+            float v = 2.0f * glm::pi<float>() * (float)j / (float)segments;
+            float r = majorRadius + minorRadius * cos(v);
+            vec3 p = center + vec3(r * cos(u), minorRadius * sin(v), r * sin(u));
+            uvec3 q = uvec3(glm::clamp((p - out.boundsMin) * scale + 0.5f, vec3(0.0f), vec3(65535.0f)));
+            out.vertices.push_back({q.x | (q.y << 16), q.z});
+        }
+    }
+    GLuint color = packColor(vec3(0.8f, 0.75f, 0.6f), false);
+    for (int i = 0; i < rings; ++i) {
+        for (int j = 0; j < segments; ++j) {
+            GLuint a = (GLuint)(i * segments + j);
+            GLuint b = (GLuint)(((i + 1) % rings) * segments + j);
+            GLuint c = (GLuint)(((i + 1) % rings) * segments + (j + 1) % segments);
+            GLuint d = (GLuint)(i * segments + (j + 1) % segments);
+            out.triangles.push_back({{a, b, c}, color});
+            out.triangles.push_back({{a, c, d}, color});
+        }
+    }
+}
 
-        vector<unsigned char> ppm_pixels(WIDTH * HEIGHT * 3);
-        for(int y = 0; y < HEIGHT; ++y) {
-            for(int x = 0; x < WIDTH; ++x) {
-                int flipped_y = HEIGHT - 1 - y;
-                int gpu_idx = (y * WIDTH + x) * 4;
-                int ppm_idx = (flipped_y * WIDTH + x) * 3;
-                ppm_pixels[ppm_idx + 0] = static_cast<unsigned char>(glm::clamp(gpu_pixels[gpu_idx + 0], 0.0f, 1.0f) * 255);
-                ppm_pixels[ppm_idx + 1] = static_cast<unsigned char>(glm::clamp(gpu_pixels[gpu_idx + 1], 0.0f, 1.0f) * 255);
-                ppm_pixels[ppm_idx + 2] = static_cast<unsigned char>(glm::clamp(gpu_pixels[gpu_idx + 2], 0.0f, 1.0f) * 255);
+// renders each fixed scene along its own camera path and writes the frame times as
+// json. every frame is finished with glFinish before the clock stops, so the numbers
+// are per frame latencies without cpu / gpu overlap, and the animation advances by a
+// fixed 1 / MOVIE_FPS per frame. the spheres come from the scene file, stars and mesh
+// are the benchmark's own
+void runBench(Engine& engine, const Scene& scene, const string& path, int frames) {
+    struct BenchSetup {
+        const char* name;
+        int numStars;
+        StarfieldMode starfield;
+        bool mesh;
+        LensingMode lensing;
+        vector<Keyframe> keys;
+    };
+    const vector<Keyframe> orbit = benchOrbitPath();
+    const vector<Keyframe> throat = benchThroatPath();
+    const BenchSetup setups[] = {
+        {"planets", 0, STARFIELD_CUBEMAP, false, LENSING_APPROXIMATE, orbit},
+        {"stars_100k", 100000, STARFIELD_BINNED, false, LENSING_APPROXIMATE, orbit},
+        {"mesh", 1000, STARFIELD_CUBEMAP, true, LENSING_APPROXIMATE, orbit},
+        {"throat", 1000, STARFIELD_CUBEMAP, false, LENSING_GEODESIC, throat},
+    };
+    static const char* lensingNames[] = {"approximate", "geodesic", "geodesic_lut"};
+
+    cout << "benchmarking " << engine.width << "x" << engine.height << ", " << frames << " frames per scene...\n";
+    engine.dynamicResolution = false;
+    engine.accumulation = false;
+    GLuint query;
+    glGenQueries(1, &query);
+
+    vector<BenchScene> results;
+    for (const BenchSetup& setup : setups) {
+        setupSpheres(scene);
+        buildOrbits();
+        srand(1);
+        generateStars(setup.numStars);
+        buildStarCells();
+        mesh = Mesh();
+        if (setup.mesh) {
+            buildBenchMesh(vec3(-100.0f, -20.0f, 60.0f), 35.0f, 12.0f, 512, 256, mesh);
+        }
+        engine.starfieldMode = setup.starfield;
+        lensingMode = setup.lensing;
+        currentUniverse = 1;
+        engine.uploadSceneData();
+
+        BenchScene result;
+        result.name = setup.name;
+        result.config = lensingNames[setup.lensing];
+        result.raysPerFrame = (double)engine.width * engine.height;
+        for (int f = -BENCH_WARMUP_FRAMES; f < frames; ++f) {
+            int frame = std::max(f, 0);
+            vec3 pos, target;
+            cameraPathAt(setup.keys, frames > 1 ? (float)frame / (float)(frames - 1) : 0.0f, pos, target);
+            setCamera(pos, target);
+
+            glFinish();
+            auto start = chrono::steady_clock::now();
+            glBeginQuery(GL_TIME_ELAPSED, query);
+            engine.beginFrame((float)frame / MOVIE_FPS);
+            engine.animate();
+            engine.computePixels();
+            glEndQuery(GL_TIME_ELAPSED);
+            glFinish();
+            double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+            GLuint64 ns = 0;
+            glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+            if (f >= 0) {
+                result.frameMs.push_back(ms);
+                result.gpuMs.push_back((double)ns * 1e-6);
             }
         }
-        writePPM(file, ppm_pixels, WIDTH, HEIGHT);
-        
-        cout << "saved frame " << (i + 1) << "/" << totalFrames << "\r" << flush;
+        printBenchScene(result);
+        results.push_back(result);
     }
-    cout << "\nrender complete: " << totalFrames << " frames written to " << exportDir << "/.\n";
-
-    cout << "running ffmpeg to create video...\n";
-    string videoFile = ss.str() + ".mp4";
-    string ffmpeg_cmd = "ffmpeg -r " + to_string(MOVIE_FPS) 
-                           + " -i " + exportDir + "/frame_%05d.ppm"
-                           + " -c:v libx264 -pix_fmt yuv420p -y " + videoFile;
-
-    int ffmpeg_ret = system(ffmpeg_cmd.c_str());
-    if (ffmpeg_ret == 0) {
-        cout << "successfully created video: " << videoFile << "\n";
+    glDeleteQueries(1, &query);
+
+    vector<pair<string, string>> info = {
+        {"device", "\"" + string((const char*)glGetString(GL_RENDERER)) + "\""},
+        {"width", to_string(engine.width)}, {"height", to_string(engine.height)},
+        {"warmup_frames", to_string(BENCH_WARMUP_FRAMES)}};
+    if (writeBenchJson(path, "gpu_compute", info, results)) {
+        cout << "benchmark results saved to " << path << "\n";
     } else {
-        cout << "error: ffmpeg command failed. you can try running it manually:\n" << ffmpeg_cmd << "\n";
+        cerr << "error: failed to write " << path << "\n";
     }
 }
 
@@ -640,48 +2851,169 @@ void runMovieMode(Engine& engine) {
 //------------------------------------------------------------------------------
 int main(int argc, char** argv) {
     bool predefinedPath = false;
+    bool cpuConvert = false;
+    bool exactStars = false;
+    bool binnedStars = false;
+    int numStars = -1; // the scene's catalog
+    string scenePath = "scene.txt";
+    string meshPath;
+    float meshScale = 1.0f;
+    vec3 meshOffset(0.0f);
+    int width = DEFAULT_WIDTH;
+    int height = DEFAULT_HEIGHT;
+    float targetFps = DEFAULT_TARGET_FPS;
+    bool accumulate = true;
+    int samplesPerFrame = 1;
+    bool headless = false;
+    string profileCsv;
+    string benchPath;
+    int benchFrames = DEFAULT_BENCH_FRAMES;
+    HdrFormat hdrFormat = HDR_NONE;
+    int numGpus = 1;
     for (int i = 1; i < argc; ++i) {
         string a = argv[i];
         if (a == "--predefined" || a == "-p") predefinedPath = true;
+        if (a == "--cpu-convert") cpuConvert = true;
+        if (a == "--headless") headless = true;
+        if (a == "--gpus" && i + 1 < argc) numGpus = std::max(0, atoi(argv[++i]));
+        if (a == "--stars-exact") exactStars = true;
+        if (a == "--stars-binned") binnedStars = true;
+        if (a == "--stars" && i + 1 < argc) numStars = std::max(0, atoi(argv[++i]));
+        if (a == "--width" && i + 1 < argc) width = std::max(1, atoi(argv[++i]));
+        if (a == "--height" && i + 1 < argc) height = std::max(1, atoi(argv[++i]));
+        if (a == "--geodesic") lensingMode = LENSING_GEODESIC;
+        if (a == "--geodesic-lut") lensingMode = LENSING_GEODESIC_LUT;
+        if (a == "--tolerance" && i + 1 < argc) geodesicTolerance = std::max(1e-8f, (float)atof(argv[++i]));
+        if (a == "--no-accumulate") accumulate = false;
+        if (a == "--spp" && i + 1 < argc) samplesPerFrame = glm::clamp(atoi(argv[++i]), 1, ACCUM_MAX_SAMPLES);
+        if (a == "--profile-csv" && i + 1 < argc) profileCsv = argv[++i];
+        if (a == "--hdr" && i + 1 < argc && !parseHdrFormat(argv[++i], hdrFormat)) {
+            cerr << "error: --hdr expects exr or raw\n";
+            return 1;
+        }
+        if (a == "--heatmap" && i + 1 < argc) {
+            string view = argv[++i];
+            debugView = DEBUG_VIEW_NONE;
+            for (int v = DEBUG_VIEW_STEPS; v <= DEBUG_VIEW_STARS; ++v) {
+                if (view == DEBUG_VIEW_NAMES[v]) debugView = (DebugView)v;
+            }
+            if (debugView == DEBUG_VIEW_NONE) {
+                cerr << "error: --heatmap expects steps, primitives or stars\n";
+                return 1;
+            }
+        }
+        if (a == "--bench" && i + 1 < argc) benchPath = argv[++i];
+        if (a == "--bench-frames" && i + 1 < argc) benchFrames = std::max(1, atoi(argv[++i]));
+        if (a == "--group-size" && i + 1 < argc) traceGroupSize = glm::clamp(atoi(argv[++i]), 1, 32);
+        if (a == "--target-fps" && i + 1 < argc) targetFps = (float)atof(argv[++i]);
+        if (a == "--mesh" && i + 1 < argc) meshPath = argv[++i];
+        if (a == "--scene" && i + 1 < argc) scenePath = argv[++i];
+        if (a == "--mesh-scale" && i + 1 < argc) meshScale = (float)atof(argv[++i]);
+        if (a == "--mesh-offset" && i + 3 < argc) {
+            meshOffset.x = (float)atof(argv[++i]);
+            meshOffset.y = (float)atof(argv[++i]);
+            meshOffset.z = (float)atof(argv[++i]);
+        }
+    }
+    bool benchmark = !benchPath.empty();
+    headless = headless || benchmark || numGpus != 1; // the benchmark never presents, like movie mode
+    if (headless && !predefinedPath && !benchmark) {
+        cout << "headless mode has nothing to show, rendering the camera path instead\n";
+        predefinedPath = true;
+    }
+    // the other gpus only render movie frames, the engine below lives on the first one
+#ifdef WORMHOLE_EGL
+    int available = std::max(1, Engine::eglDeviceCount());
+    if (numGpus == 0 || numGpus > available) {
+        numGpus = available;
+    }
+#else
+    if (numGpus != 1) {
+        cout << "multi-gpu rendering needs the egl build, rendering on one gpu\n";
+    }
+    numGpus = 1;
+#endif
+    Engine engine(width, height, headless);
+    engine.gpuQuantize = !cpuConvert;
+    // movie frames are always traced at full resolution, without the temporal upsampler
+    engine.dynamicResolution = !predefinedPath && targetFps > 0.0f;
+    if (engine.dynamicResolution) {
+        engine.targetFrameTime = 1.0f / targetFps;
+    }
+    // interactive mode refines whenever the view is still, movie mode for --spp samples
+    engine.accumulation = predefinedPath ? samplesPerFrame > 1 : accumulate;
+    engine.starfieldMode = binnedStars ? STARFIELD_BINNED : (exactStars ? STARFIELD_EXACT : STARFIELD_CUBEMAP);
+    if (!profileCsv.empty() && !engine.profiler.openCsv(profileCsv)) {
+        cout << "error: could not write " << profileCsv << "\n";
     }
-    Engine engine;
     
-    glfwSetKeyCallback(engine.window, keyCallback);
-    glfwSetMouseButtonCallback(engine.window, mouseButtonCallback);
-    glfwSetCursorPosCallback(engine.window, cursorPosCallback);
-    glfwSetScrollCallback(engine.window, scrollCallback);
+    if (!headless) {
+        glfwSetKeyCallback(engine.window, keyCallback);
+        glfwSetMouseButtonCallback(engine.window, mouseButtonCallback);
+        glfwSetCursorPosCallback(engine.window, cursorPosCallback);
+        glfwSetScrollCallback(engine.window, scrollCallback);
+        glfwSetFramebufferSizeCallback(engine.window, framebufferSizeCallback);
+    }
     
     cout << "\nwormhole simulation\n\n";
 
-    spheres.push_back(Sphere(vec3(0, 5000, -6000), 1000, vec3(1.0f, 0.9f, 0.7f), true, 1));
-    spheres.push_back(Sphere(vec3(-80, 40, 0), 10, vec3(1.0f, 0.2f, 0.2f), false, 1));
-    spheres.push_back(Sphere(vec3(-80, -40, 0), 10, vec3(0.2f, 1.0f, 0.2f), false, 1));
-    spheres.push_back(Sphere(vec3(-100, 0, 50), 10, vec3(0.2f, 0.2f, 1.0f), false, 1));
-    spheres.push_back(Sphere(vec3(-120, 0, 0), 12, vec3(1.0f, 0.5f, 0.0f), false, 1));
-
-    spheres.push_back(Sphere(vec3(0, -7000, 8000), 1500, vec3(0.7f, 0.8f, 1.0f), true, 2));
-    spheres.push_back(Sphere(vec3(80, 40, 0), 18, vec3(1.0f, 1.0f, 0.2f), false, 2));
-    spheres.push_back(Sphere(vec3(80, -40, 0), 18, vec3(1.0f, 0.2f, 1.0f), false, 2));
-    spheres.push_back(Sphere(vec3(100, 0, 50), 18, vec3(0.2f, 1.0f, 1.0f), false, 2));
-    spheres.push_back(Sphere(vec3(120, 0, 0), 22, vec3(1.0f, 1.0f, 1.0f), false, 2));
-    
+    Scene scene;
+    auto sceneStart = chrono::steady_clock::now();
+    if (!loadScene(scenePath, scene)) {
+        return 1;
+    }
+    cout << "loaded scene " << scenePath << (scene.cached ? " from cache" : "") << ": " << scene.spheres.size() << " spheres, "
+         << scene.stars.size() << " stars in " << fixed << setprecision(2)
+         << chrono::duration<double, milli>(chrono::steady_clock::now() - sceneStart).count() << " ms\n";
+    cout.unsetf(ios::fixed);
+
+    throatRadius = scene.throatRadius;
+    setupSpheres(scene);
     currentUniverse = 1;
     
-    generateStars(1000);
+    buildOrbits();
+    if (numStars >= 0) {
+        generateStars(numStars);
+    } else {
+        setupStars(scene);
+    }
+    buildStarCells();
+    if (meshPath.empty() && !scene.meshes.empty()) {
+        const SceneMesh& m = scene.meshes[0];
+        meshPath = m.path;
+        meshScale = m.scale;
+        meshOffset = vec3(m.offset[0], m.offset[1], m.offset[2]);
+        if (scene.meshes.size() > 1) {
+            cout << "only the first of the scene's " << scene.meshes.size() << " meshes is loaded\n";
+        }
+    }
+    if (!meshPath.empty()) {
+        loadMesh(meshPath, meshScale, meshOffset);
+    }
     engine.uploadSceneData();
 
-    cout << "universe 1 has a yellow sun and " << 4 << " planets.\n";
-    cout << "universe 2 has a blue sun and " << 4 << " planets.\n";
+    for (int universe = 1; universe <= 2; ++universe) {
+        int planets = 0;
+        for (const Sphere& s : spheres) {
+            planets += (int)s.properties.y == universe && s.properties.x < 0.5f;
+        }
+        cout << "universe " << universe << " has " << (scene.sunIndex[universe - 1] >= 0 ? "a sun and " : "no sun and ")
+             << planets << " planets.\n";
+    }
     
-    const auto initialSpheres = spheres;
-
-    if (predefinedPath) {
-        runMovieMode(engine);
+    if (benchmark) {
+        runBench(engine, scene, benchPath, benchFrames);
+    } else if (predefinedPath) {
+        runMovieMode(engine, samplesPerFrame, hdrFormat, numGpus);
     } else {
-        runInteractiveMode(engine, initialSpheres);
+        runInteractiveMode(engine);
     }
+    engine.profiler.finish();
 
     cout << "\nsimulation ended.\n";
+#ifdef WORMHOLE_EGL
+    engine.destroyContext();
+#endif
     glfwTerminate();
     return 0;
 }